@@ -0,0 +1,614 @@
+#include "GLES1_AttribStack.h"
+#include "GLES1_SoftwareRasterizer.h"
+
+#include <QDebug>
+
+#include <cstring>
+
+// the capabilities the enable bits stand for
+static const GLenum capabilities[GLES1_AttribStack::capabilityCount] = {
+    GL_BLEND,
+    GL_CULL_FACE,
+    GL_DEPTH_TEST,
+    GL_DITHER,
+    GL_POLYGON_OFFSET_FILL,
+    GL_SAMPLE_ALPHA_TO_COVERAGE,
+    GL_SAMPLE_COVERAGE,
+    GL_SCISSOR_TEST,
+    GL_STENCIL_TEST,
+};
+
+template <typename T>
+static inline void save(char *& cursor, const T & value)
+{
+    memcpy(cursor, &value, sizeof(T));
+    cursor += sizeof(T);
+}
+
+template <typename T>
+static inline void load(const char *& cursor, T & value)
+{
+    memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+}
+
+GLES1_AttribStack::GLES1_AttribStack(QOpenGLContext *context)
+    : GLES1_AttribStack(context->functions(), nullptr)
+{
+}
+
+GLES1_AttribStack::GLES1_AttribStack(GLES1_SoftwareRasterizer *software)
+    : GLES1_AttribStack(nullptr, software)
+{
+}
+
+GLES1_AttribStack::GLES1_AttribStack(QOpenGLFunctions *gles2, GLES1_SoftwareRasterizer *software)
+    : gles2(gles2), software(software)
+{
+    // sized once for maxDepth full records, push and pop only move arenaUsed
+    const int recordSize = sizeof(Header) + sizeof(Current) + sizeof(ColorBuffer) + sizeof(DepthBuffer)
+            + sizeof(Viewport) + sizeof(scissorBox) + sizeof(Texture);
+    arena.resize(maxDepth * recordSize);
+    recordStarts.reserve(maxDepth);
+}
+
+int GLES1_AttribStack::capabilityIndex(GLenum capability)
+{
+    for (int i = 0; i < capabilityCount; i++) {
+        if (capabilities[i] == capability) return i;
+    }
+    return -1;
+}
+
+quint32 GLES1_AttribStack::enabledMask(GLbitfield mask)
+{
+    if (mask & GL_ENABLE_BIT) return (1u << capabilityCount) - 1;
+    quint32 bits = 0;
+    if (mask & GL_COLOR_BUFFER_BIT) bits |= 1u << capabilityIndex(GL_BLEND) | 1u << capabilityIndex(GL_DITHER);
+    if (mask & GL_DEPTH_BUFFER_BIT) bits |= 1u << capabilityIndex(GL_DEPTH_TEST);
+    if (mask & GL_SCISSOR_BIT) bits |= 1u << capabilityIndex(GL_SCISSOR_TEST);
+    return bits;
+}
+
+void GLES1_AttribStack::sync()
+{
+    if (software != nullptr) {
+        syncSoftware();
+        return;
+    }
+
+    auto getEnum = [this](GLenum name) {
+        GLint value;
+        gles2->glGetIntegerv(name, &value);
+        return static_cast<GLenum>(value);
+    };
+
+    enabled = 0;
+    for (int i = 0; i < capabilityCount; i++) {
+        if (gles2->glIsEnabled(capabilities[i])) enabled |= 1u << i;
+    }
+
+    colorBuffer.blendSourceRGB = getEnum(GL_BLEND_SRC_RGB);
+    colorBuffer.blendDestinationRGB = getEnum(GL_BLEND_DST_RGB);
+    colorBuffer.blendSourceAlpha = getEnum(GL_BLEND_SRC_ALPHA);
+    colorBuffer.blendDestinationAlpha = getEnum(GL_BLEND_DST_ALPHA);
+    colorBuffer.blendEquationRGB = getEnum(GL_BLEND_EQUATION_RGB);
+    colorBuffer.blendEquationAlpha = getEnum(GL_BLEND_EQUATION_ALPHA);
+    gles2->glGetBooleanv(GL_COLOR_WRITEMASK, colorBuffer.colorMask);
+    gles2->glGetFloatv(GL_COLOR_CLEAR_VALUE, colorBuffer.clearColor);
+
+    depthBuffer.depthFunc = getEnum(GL_DEPTH_FUNC);
+    gles2->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthBuffer.depthMask);
+    gles2->glGetFloatv(GL_DEPTH_CLEAR_VALUE, &depthBuffer.clearDepth);
+
+    gles2->glGetIntegerv(GL_VIEWPORT, viewport.viewport);
+    gles2->glGetFloatv(GL_DEPTH_RANGE, viewport.depthRange);
+    gles2->glGetIntegerv(GL_SCISSOR_BOX, scissorBox);
+
+    texture.activeTexture = getEnum(GL_ACTIVE_TEXTURE);
+    GLint units;
+    gles2->glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units);
+    unitCount = qMin<int>(units, textureUnits);
+    for (int i = 0; i < textureUnits; i++) {
+        texture.textures[i] = 0;
+    }
+    for (int i = 0; i < unitCount; i++) {
+        gles2->glActiveTexture(GL_TEXTURE0 + i);
+        texture.textures[i] = getEnum(GL_TEXTURE_BINDING_2D);
+    }
+    gles2->glActiveTexture(texture.activeTexture);
+
+    synced = true;
+}
+
+void GLES1_AttribStack::syncSoftware()
+{
+    const GLES1_SoftwareRasterizer::State & state = software->state();
+    enabled = 0;
+    for (int i = 0; i < capabilityCount; i++) {
+        if (software->isEnabled(capabilities[i])) enabled |= 1u << i;
+    }
+
+    colorBuffer.blendSourceRGB = state.blendSourceRGB;
+    colorBuffer.blendDestinationRGB = state.blendDestinationRGB;
+    colorBuffer.blendSourceAlpha = state.blendSourceAlpha;
+    colorBuffer.blendDestinationAlpha = state.blendDestinationAlpha;
+    colorBuffer.blendEquationRGB = state.blendEquationRGB;
+    colorBuffer.blendEquationAlpha = state.blendEquationAlpha;
+    memcpy(colorBuffer.colorMask, state.colorMask, sizeof(colorBuffer.colorMask));
+    memcpy(colorBuffer.clearColor, state.clearColor, sizeof(colorBuffer.clearColor));
+
+    depthBuffer.depthFunc = state.depthFunc;
+    depthBuffer.depthMask = state.depthMask;
+    depthBuffer.clearDepth = state.clearDepth;
+
+    memcpy(viewport.viewport, state.viewport, sizeof(viewport.viewport));
+    memcpy(viewport.depthRange, state.depthRange, sizeof(viewport.depthRange));
+    memcpy(scissorBox, state.scissorBox, sizeof(scissorBox));
+
+    // bindings are only remembered, the rasterizer does not texture
+    texture.activeTexture = GL_TEXTURE0;
+    unitCount = textureUnits;
+    for (int i = 0; i < textureUnits; i++) {
+        texture.textures[i] = 0;
+    }
+
+    synced = true;
+}
+
+void GLES1_AttribStack::invalidate()
+{
+    synced = false;
+}
+
+bool GLES1_AttribStack::push(GLbitfield mask, const Current &current)
+{
+    if (recordStarts.length() == maxDepth) {
+        qWarning() << "GLES1_Wrapper: glPushAttrib overflows the attribute stack of" << maxDepth << "levels";
+        return false;
+    }
+    ensureSynced();
+
+    recordStarts.append(arenaUsed);
+    char * out = arena.data() + arenaUsed;
+    Header header;
+    header.mask = mask;
+    header.enabledMask = enabledMask(mask);
+    header.enabled = enabled;
+    save(out, header);
+    if (mask & GL_CURRENT_BIT) {
+        save(out, current.color);
+        save(out, current.normal);
+    }
+    if (mask & GL_TRANSFORM_BIT) save(out, current.matrixMode);
+    if (mask & GL_COLOR_BUFFER_BIT) save(out, colorBuffer);
+    if (mask & GL_DEPTH_BUFFER_BIT) save(out, depthBuffer);
+    if (mask & GL_VIEWPORT_BIT) save(out, viewport);
+    if (mask & GL_SCISSOR_BIT) save(out, scissorBox);
+    if (mask & GL_TEXTURE_BIT) save(out, texture);
+    arenaUsed = out - arena.data();
+    return true;
+}
+
+GLbitfield GLES1_AttribStack::pop(Current &current)
+{
+    if (recordStarts.isEmpty()) {
+        qWarning() << "GLES1_Wrapper: glPopAttrib without a matching glPushAttrib";
+        return 0;
+    }
+    ensureSynced();
+
+    int start = recordStarts.takeLast();
+    const char * cursor = arena.constData() + start;
+    Header header;
+    load(cursor, header);
+    GLbitfield mask = header.mask;
+    if (mask & GL_CURRENT_BIT) {
+        load(cursor, current.color);
+        load(cursor, current.normal);
+    }
+    if (mask & GL_TRANSFORM_BIT) load(cursor, current.matrixMode);
+
+    // the setters skip whatever already matches
+    applyEnabled(header.enabled, header.enabledMask);
+    if (mask & GL_COLOR_BUFFER_BIT) {
+        ColorBuffer saved;
+        load(cursor, saved);
+        blendFuncSeparate(saved.blendSourceRGB, saved.blendDestinationRGB, saved.blendSourceAlpha, saved.blendDestinationAlpha);
+        blendEquationSeparate(saved.blendEquationRGB, saved.blendEquationAlpha);
+        colorMask(saved.colorMask[0], saved.colorMask[1], saved.colorMask[2], saved.colorMask[3]);
+        clearColor(saved.clearColor[0], saved.clearColor[1], saved.clearColor[2], saved.clearColor[3]);
+    }
+    if (mask & GL_DEPTH_BUFFER_BIT) {
+        DepthBuffer saved;
+        load(cursor, saved);
+        depthFunc(saved.depthFunc);
+        depthMask(saved.depthMask);
+        clearDepth(saved.clearDepth);
+    }
+    if (mask & GL_VIEWPORT_BIT) {
+        Viewport saved;
+        load(cursor, saved);
+        setViewport(saved.viewport[0], saved.viewport[1], saved.viewport[2], saved.viewport[3]);
+        depthRange(saved.depthRange[0], saved.depthRange[1]);
+    }
+    if (mask & GL_SCISSOR_BIT) {
+        GLint saved[4];
+        load(cursor, saved);
+        scissor(saved[0], saved[1], saved[2], saved[3]);
+    }
+    if (mask & GL_TEXTURE_BIT) {
+        Texture saved;
+        load(cursor, saved);
+        applyTexture(saved);
+    }
+
+    arenaUsed = start;
+    return mask;
+}
+
+int GLES1_AttribStack::depth() const
+{
+    return recordStarts.length();
+}
+
+void GLES1_AttribStack::applyEnabled(quint32 bits, quint32 mask)
+{
+    quint32 changed = (enabled ^ bits) & mask;
+    if (changed == 0) {
+        if (mask != 0) skipped++;
+        return;
+    }
+    for (int i = 0; i < capabilityCount; i++) {
+        quint32 bit = 1u << i;
+        if ((changed & bit) == 0) continue;
+        if (software != nullptr) {
+            software->setEnabled(capabilities[i], bits & bit);
+        } else if (bits & bit) {
+            gles2->glEnable(capabilities[i]);
+        } else {
+            gles2->glDisable(capabilities[i]);
+        }
+    }
+    enabled ^= changed;
+}
+
+void GLES1_AttribStack::applyTexture(const Texture &saved)
+{
+    for (int i = 0; i < unitCount; i++) {
+        if (texture.textures[i] != saved.textures[i]) {
+            activeTexture(GL_TEXTURE0 + i);
+            bindTexture(GL_TEXTURE_2D, saved.textures[i]);
+        }
+    }
+    activeTexture(saved.activeTexture);
+}
+
+void GLES1_AttribStack::setEnabled(GLenum capability, bool enable)
+{
+    int index = capabilityIndex(capability);
+    if (index < 0) {
+        if (software != nullptr) {
+            software->setEnabled(capability, enable);
+        } else if (enable) {
+            gles2->glEnable(capability);
+        } else {
+            gles2->glDisable(capability);
+        }
+        return;
+    }
+    ensureSynced();
+    applyEnabled(enable ? ~0u : 0, 1u << index);
+}
+
+void GLES1_AttribStack::blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+    ensureSynced();
+    if (colorBuffer.blendSourceRGB == sourceRGB && colorBuffer.blendDestinationRGB == destinationRGB
+            && colorBuffer.blendSourceAlpha == sourceAlpha && colorBuffer.blendDestinationAlpha == destinationAlpha) {
+        skipped++;
+        return;
+    }
+    colorBuffer.blendSourceRGB = sourceRGB;
+    colorBuffer.blendDestinationRGB = destinationRGB;
+    colorBuffer.blendSourceAlpha = sourceAlpha;
+    colorBuffer.blendDestinationAlpha = destinationAlpha;
+    if (software != nullptr) {
+        software->blendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+    } else {
+        gles2->glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+    }
+}
+
+void GLES1_AttribStack::blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+{
+    ensureSynced();
+    if (colorBuffer.blendEquationRGB == modeRGB && colorBuffer.blendEquationAlpha == modeAlpha) {
+        skipped++;
+        return;
+    }
+    colorBuffer.blendEquationRGB = modeRGB;
+    colorBuffer.blendEquationAlpha = modeAlpha;
+    if (software != nullptr) {
+        software->blendEquationSeparate(modeRGB, modeAlpha);
+    } else {
+        gles2->glBlendEquationSeparate(modeRGB, modeAlpha);
+    }
+}
+
+void GLES1_AttribStack::colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    ensureSynced();
+    GLboolean * mask = colorBuffer.colorMask;
+    if (mask[0] == red && mask[1] == green && mask[2] == blue && mask[3] == alpha) {
+        skipped++;
+        return;
+    }
+    mask[0] = red;
+    mask[1] = green;
+    mask[2] = blue;
+    mask[3] = alpha;
+    if (software != nullptr) {
+        software->colorMask(red, green, blue, alpha);
+    } else {
+        gles2->glColorMask(red, green, blue, alpha);
+    }
+}
+
+void GLES1_AttribStack::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    ensureSynced();
+    GLfloat * color = colorBuffer.clearColor;
+    if (color[0] == red && color[1] == green && color[2] == blue && color[3] == alpha) {
+        skipped++;
+        return;
+    }
+    color[0] = red;
+    color[1] = green;
+    color[2] = blue;
+    color[3] = alpha;
+    if (software != nullptr) {
+        software->clearColor(red, green, blue, alpha);
+    } else {
+        gles2->glClearColor(red, green, blue, alpha);
+    }
+}
+
+void GLES1_AttribStack::depthFunc(GLenum func)
+{
+    ensureSynced();
+    if (depthBuffer.depthFunc == func) {
+        skipped++;
+        return;
+    }
+    depthBuffer.depthFunc = func;
+    if (software != nullptr) {
+        software->depthFunc(func);
+    } else {
+        gles2->glDepthFunc(func);
+    }
+}
+
+void GLES1_AttribStack::depthMask(GLboolean flag)
+{
+    ensureSynced();
+    if (depthBuffer.depthMask == flag) {
+        skipped++;
+        return;
+    }
+    depthBuffer.depthMask = flag;
+    if (software != nullptr) {
+        software->depthMask(flag);
+    } else {
+        gles2->glDepthMask(flag);
+    }
+}
+
+void GLES1_AttribStack::clearDepth(GLfloat depth)
+{
+    ensureSynced();
+    if (depthBuffer.clearDepth == depth) {
+        skipped++;
+        return;
+    }
+    depthBuffer.clearDepth = depth;
+    if (software != nullptr) {
+        software->clearDepth(depth);
+    } else {
+        gles2->glClearDepthf(depth);
+    }
+}
+
+void GLES1_AttribStack::setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    ensureSynced();
+    GLint * box = viewport.viewport;
+    if (box[0] == x && box[1] == y && box[2] == width && box[3] == height) {
+        skipped++;
+        return;
+    }
+    box[0] = x;
+    box[1] = y;
+    box[2] = width;
+    box[3] = height;
+    if (software != nullptr) {
+        software->setViewport(x, y, width, height);
+    } else {
+        gles2->glViewport(x, y, width, height);
+    }
+}
+
+void GLES1_AttribStack::depthRange(GLfloat nearVal, GLfloat farVal)
+{
+    ensureSynced();
+    if (viewport.depthRange[0] == nearVal && viewport.depthRange[1] == farVal) {
+        skipped++;
+        return;
+    }
+    viewport.depthRange[0] = nearVal;
+    viewport.depthRange[1] = farVal;
+    if (software != nullptr) {
+        software->depthRange(nearVal, farVal);
+    } else {
+        gles2->glDepthRangef(nearVal, farVal);
+    }
+}
+
+void GLES1_AttribStack::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    ensureSynced();
+    if (scissorBox[0] == x && scissorBox[1] == y && scissorBox[2] == width && scissorBox[3] == height) {
+        skipped++;
+        return;
+    }
+    scissorBox[0] = x;
+    scissorBox[1] = y;
+    scissorBox[2] = width;
+    scissorBox[3] = height;
+    if (software != nullptr) {
+        software->scissor(x, y, width, height);
+    } else {
+        gles2->glScissor(x, y, width, height);
+    }
+}
+
+void GLES1_AttribStack::activeTexture(GLenum unit)
+{
+    ensureSynced();
+    if (texture.activeTexture == unit) {
+        skipped++;
+        return;
+    }
+    texture.activeTexture = unit;
+    if (software == nullptr) gles2->glActiveTexture(unit);
+}
+
+void GLES1_AttribStack::bindTexture(GLenum target, GLuint name)
+{
+    ensureSynced();
+    int unit = texture.activeTexture - GL_TEXTURE0;
+    if (target != GL_TEXTURE_2D || unit < 0 || unit >= unitCount) {
+        if (software == nullptr) gles2->glBindTexture(target, name);
+        return;
+    }
+    if (texture.textures[unit] == name) {
+        skipped++;
+        return;
+    }
+    texture.textures[unit] = name;
+    if (software == nullptr) gles2->glBindTexture(target, name);
+}
+
+void GLES1_AttribStack::deleteTextures(GLsizei count, const GLuint *names)
+{
+    if (software == nullptr) gles2->glDeleteTextures(count, names);
+    if (!synced) return;
+    for (GLsizei i = 0; i < count; i++) {
+        for (int unit = 0; unit < unitCount; unit++) {
+            if (texture.textures[unit] == names[i]) texture.textures[unit] = 0;
+        }
+    }
+}
+
+bool GLES1_AttribStack::isEnabled(GLenum capability)
+{
+    int index = capabilityIndex(capability);
+    if (index < 0) {
+        return software != nullptr ? software->isEnabled(capability) : gles2->glIsEnabled(capability);
+    }
+    ensureSynced();
+    return enabled & (1u << index);
+}
+
+GLuint GLES1_AttribStack::getTexture2D()
+{
+    ensureSynced();
+    int unit = texture.activeTexture - GL_TEXTURE0;
+    if (unit >= 0 && unit < unitCount) return texture.textures[unit];
+    if (software != nullptr) return 0;
+    GLint name;
+    gles2->glGetIntegerv(GL_TEXTURE_BINDING_2D, &name);
+    return name;
+}
+
+GLES1_AttribStack::Snapshot GLES1_AttribStack::snapshot()
+{
+    ensureSynced();
+    Snapshot state;
+    state.enabled = enabled;
+    state.blendFunc[0] = colorBuffer.blendSourceRGB;
+    state.blendFunc[1] = colorBuffer.blendDestinationRGB;
+    state.blendFunc[2] = colorBuffer.blendSourceAlpha;
+    state.blendFunc[3] = colorBuffer.blendDestinationAlpha;
+    state.blendEquation[0] = colorBuffer.blendEquationRGB;
+    state.blendEquation[1] = colorBuffer.blendEquationAlpha;
+    memcpy(state.colorMask, colorBuffer.colorMask, sizeof(state.colorMask));
+    state.depthMask = depthBuffer.depthMask;
+    state.depthFunc = depthBuffer.depthFunc;
+    memcpy(state.viewport, viewport.viewport, sizeof(state.viewport));
+    memcpy(state.depthRange, viewport.depthRange, sizeof(state.depthRange));
+    memcpy(state.scissorBox, scissorBox, sizeof(state.scissorBox));
+    return state;
+}
+
+void GLES1_AttribStack::restore(const Snapshot &state)
+{
+    // compared here so that the skipped count only reflects the callers of the setters
+    const Snapshot now = snapshot();
+    if (state.enabled != now.enabled) {
+        applyEnabled(state.enabled, (1u << capabilityCount) - 1);
+    }
+    if (memcmp(state.blendFunc, now.blendFunc, sizeof(state.blendFunc)) != 0) {
+        blendFuncSeparate(state.blendFunc[0], state.blendFunc[1], state.blendFunc[2], state.blendFunc[3]);
+    }
+    if (memcmp(state.blendEquation, now.blendEquation, sizeof(state.blendEquation)) != 0) {
+        blendEquationSeparate(state.blendEquation[0], state.blendEquation[1]);
+    }
+    if (memcmp(state.colorMask, now.colorMask, sizeof(state.colorMask)) != 0) {
+        colorMask(state.colorMask[0], state.colorMask[1], state.colorMask[2], state.colorMask[3]);
+    }
+    if (state.depthMask != now.depthMask) {
+        depthMask(state.depthMask);
+    }
+    if (state.depthFunc != now.depthFunc) {
+        depthFunc(state.depthFunc);
+    }
+    if (memcmp(state.viewport, now.viewport, sizeof(state.viewport)) != 0) {
+        setViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+    }
+    if (memcmp(state.depthRange, now.depthRange, sizeof(state.depthRange)) != 0) {
+        depthRange(state.depthRange[0], state.depthRange[1]);
+    }
+    if (memcmp(state.scissorBox, now.scissorBox, sizeof(state.scissorBox)) != 0) {
+        scissor(state.scissorBox[0], state.scissorBox[1], state.scissorBox[2], state.scissorBox[3]);
+    }
+}
+
+bool GLES1_AttribStack::Snapshot::isEnabled(GLenum capability) const
+{
+    int index = capabilityIndex(capability);
+    return index >= 0 && (enabled & (1u << index));
+}
+
+bool GLES1_AttribStack::Snapshot::operator==(const Snapshot &other) const
+{
+    return enabled == other.enabled
+            && memcmp(blendFunc, other.blendFunc, sizeof(blendFunc)) == 0
+            && memcmp(blendEquation, other.blendEquation, sizeof(blendEquation)) == 0
+            && memcmp(colorMask, other.colorMask, sizeof(colorMask)) == 0
+            && depthMask == other.depthMask
+            && depthFunc == other.depthFunc
+            && memcmp(viewport, other.viewport, sizeof(viewport)) == 0
+            && memcmp(depthRange, other.depthRange, sizeof(depthRange)) == 0
+            && memcmp(scissorBox, other.scissorBox, sizeof(scissorBox)) == 0;
+}
+
+quint64 GLES1_AttribStack::skippedCount() const
+{
+    return skipped;
+}
+
+void GLES1_AttribStack::resetCounters()
+{
+    skipped = 0;
+}
@@ -0,0 +1,198 @@
+#ifndef GLES1_ATTRIBSTACK_H
+#define GLES1_ATTRIBSTACK_H
+
+#include <QByteArray>
+#include <QList>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+class GLES1_SoftwareRasterizer;
+
+#ifndef GL_CURRENT_BIT
+#define GL_CURRENT_BIT 0x00000001
+#endif
+#ifndef GL_VIEWPORT_BIT
+#define GL_VIEWPORT_BIT 0x00000800
+#endif
+#ifndef GL_TRANSFORM_BIT
+#define GL_TRANSFORM_BIT 0x00001000
+#endif
+#ifndef GL_ENABLE_BIT
+#define GL_ENABLE_BIT 0x00002000
+#endif
+#ifndef GL_TEXTURE_BIT
+#define GL_TEXTURE_BIT 0x00040000
+#endif
+#ifndef GL_SCISSOR_BIT
+#define GL_SCISSOR_BIT 0x00080000
+#endif
+#ifndef GL_ALL_ATTRIB_BITS
+#define GL_ALL_ATTRIB_BITS 0xFFFFFFFF
+#endif
+
+// glPushAttrib/glPopAttrib over a shadow of the GL state
+//
+// the shadow is read from GL once and kept current by the wrapper's state setters, a push makes no GL
+// calls and a pop only those for the state that differs
+//
+// a push copies the whole groups named in its mask, not deltas, into an arena allocated for maxDepth
+// full records, a push past maxDepth fails with a warning
+//
+// saved: color, normal and matrix mode, the enable bits, blend, color mask, clear color, depth, viewport,
+// scissor and the GL_TEXTURE_2D binding of the first textureUnits units, state changed without the wrapper
+// is only seen after invalidate
+//
+// over a GLES1_SoftwareRasterizer the shadow is applied to the rasterizer, texture bindings are only remembered
+
+class GLES1_AttribStack
+{
+public:
+
+    // the wrapper state saved with GL_CURRENT_BIT and GL_TRANSFORM_BIT
+    struct Current {
+        GLfloat color[4];
+        GLfloat normal[3];
+        GLenum matrixMode;
+    };
+
+    // the shadowed state a draw depends on, apart from the texture bindings
+    struct Snapshot {
+        quint32 enabled;
+        GLenum blendFunc[4];
+        GLenum blendEquation[2];
+        GLboolean colorMask[4];
+        GLboolean depthMask;
+        GLenum depthFunc;
+        GLint viewport[4];
+        GLfloat depthRange[2];
+        GLint scissorBox[4];
+
+        bool isEnabled(GLenum capability) const;
+        bool operator==(const Snapshot & other) const;
+    };
+
+    static const int capabilityCount = 9;
+    static const int textureUnits = 8;
+    static const int maxDepth = 64;
+
+private:
+
+    struct ColorBuffer {
+        GLenum blendSourceRGB;
+        GLenum blendDestinationRGB;
+        GLenum blendSourceAlpha;
+        GLenum blendDestinationAlpha;
+        GLenum blendEquationRGB;
+        GLenum blendEquationAlpha;
+        GLboolean colorMask[4];
+        GLfloat clearColor[4];
+    };
+
+    struct DepthBuffer {
+        GLenum depthFunc;
+        GLboolean depthMask;
+        GLfloat clearDepth;
+    };
+
+    struct Viewport {
+        GLint viewport[4];
+        GLfloat depthRange[2];
+    };
+
+    struct Texture {
+        GLenum activeTexture;
+        GLuint textures[textureUnits];
+    };
+
+    // followed by the groups of mask in the order of the members of the shadow
+    struct Header {
+        GLbitfield mask;
+        // the enable bits restored, those of GL_ENABLE_BIT or of the groups owning them
+        quint32 enabledMask;
+        quint32 enabled;
+    };
+
+    QOpenGLFunctions * gles2;
+    GLES1_SoftwareRasterizer * software;
+
+    // a bit per entry of capabilities
+    quint32 enabled;
+    ColorBuffer colorBuffer;
+    DepthBuffer depthBuffer;
+    Viewport viewport;
+    GLint scissorBox[4];
+    Texture texture;
+    int unitCount;
+    bool synced = false;
+
+    QByteArray arena;
+    int arenaUsed = 0;
+    QList<int> recordStarts;
+
+    quint64 skipped = 0;
+
+    static int capabilityIndex(GLenum capability);
+    static quint32 enabledMask(GLbitfield mask);
+
+    inline void ensureSynced() {
+        if (Q_UNLIKELY(!synced)) sync();
+    }
+
+    GLES1_AttribStack(QOpenGLFunctions * gles2, GLES1_SoftwareRasterizer * software);
+
+    void sync();
+    void syncSoftware();
+    void applyEnabled(quint32 bits, quint32 mask);
+    void applyTexture(const Texture & saved);
+
+public:
+
+    // no GL calls are made until the state is first used
+    GLES1_AttribStack(QOpenGLContext * context);
+    GLES1_AttribStack(GLES1_SoftwareRasterizer * software);
+    GLES1_AttribStack(const GLES1_AttribStack &) = delete;
+    GLES1_AttribStack & operator=(const GLES1_AttribStack &) = delete;
+
+    // rereads the shadow before its next use
+    void invalidate();
+
+    // false when the stack is full
+    bool push(GLbitfield mask, const Current & current);
+
+    // restores the groups of the last push, those of Current into current, returns their mask or 0 when the stack is empty
+    GLbitfield pop(Current & current);
+
+    int depth() const;
+
+    // the setters the shadow follows, capabilities and texture targets it does not track are passed through
+    void setEnabled(GLenum capability, bool enable);
+    void blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+    void blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha);
+    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean flag);
+    void clearDepth(GLfloat depth);
+    void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void depthRange(GLfloat nearVal, GLfloat farVal);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint name);
+    // deleting a bound texture binds 0 in its place
+    void deleteTextures(GLsizei count, const GLuint * names);
+
+    // the shadowed state, queried from GL only for what is not shadowed
+    bool isEnabled(GLenum capability);
+    // of the active unit
+    GLuint getTexture2D();
+
+    Snapshot snapshot();
+    // applies the groups that differ
+    void restore(const Snapshot & state);
+
+    // setter calls skipped because they would not have changed the state
+    quint64 skippedCount() const;
+    void resetCounters();
+};
+
+#endif // GLES1_ATTRIBSTACK_H
@@ -0,0 +1,224 @@
+#include "GLES1_IndexedMesh.h"
+
+#include <cstring>
+
+static const GLuint emptySlot = ~0u;
+
+static quint32 hashVertex(const GLES1_Vertex & v)
+{
+    // FNV-1a over the bit patterns of the components
+    quint32 words[sizeof(GLES1_Vertex) / sizeof(quint32)];
+    memcpy(words, &v, sizeof(words));
+    quint32 h = 2166136261u;
+    for (quint32 bits : words) {
+        h = (h ^ bits) * 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+bool GLES1_IndexedMesh::canIndex(GLenum mode)
+{
+    switch (mode) {
+    case GL_TRIANGLES:
+    case GL_TRIANGLE_STRIP:
+    case GL_QUADS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int GLES1_IndexedMesh::uniqueVertices(const GLES1_Vertex *vertexData, int vertexCount)
+{
+    int tableSize = 1;
+    while (tableSize < vertexCount * 2) {
+        tableSize <<= 1;
+    }
+    const GLuint mask = tableSize - 1;
+
+    hashTable.resize(tableSize);
+    hashTable.fill(emptySlot);
+    remap.resize(vertexCount);
+    firstOccurrence.clear();
+
+    // the table stores the submitted index of the first occurrence of each unique vertex
+    for (int i = 0; i < vertexCount; i++) {
+        const GLES1_Vertex & v = vertexData[i];
+        GLuint slot = hashVertex(v) & mask;
+        while (true) {
+            GLuint first = hashTable[slot];
+            if (first == emptySlot) {
+                hashTable[slot] = i;
+                remap[i] = firstOccurrence.length();
+                firstOccurrence.append(i);
+                break;
+            }
+            if (memcmp(&vertexData[first], &v, sizeof(GLES1_Vertex)) == 0) {
+                remap[i] = remap[first];
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return firstOccurrence.length();
+}
+
+void GLES1_IndexedMesh::triangulate(GLenum mode, int vertexCount)
+{
+    triangles.clear();
+
+    auto add = [this](int i0, int i1, int i2) {
+        GLuint a = remap[i0];
+        GLuint b = remap[i1];
+        GLuint c = remap[i2];
+        // strips are commonly stitched with repeated vertices, those triangles cover no pixels
+        if (a == b || b == c || a == c) return;
+        triangles.append({a, b, c});
+    };
+
+    switch (mode) {
+    case GL_TRIANGLES:
+        for (int i = 0; i + 2 < vertexCount; i += 3) {
+            add(i, i + 1, i + 2);
+        }
+        break;
+    case GL_TRIANGLE_STRIP:
+        for (int i = 0; i + 2 < vertexCount; i++) {
+            // every odd triangle is flipped to keep the winding consistent
+            if (i & 1) {
+                add(i + 1, i, i + 2);
+            } else {
+                add(i, i + 1, i + 2);
+            }
+        }
+        break;
+    case GL_QUADS:
+        for (int i = 0; i + 3 < vertexCount; i += 4) {
+            add(i, i + 1, i + 2);
+            add(i, i + 2, i + 3);
+        }
+        break;
+    }
+}
+
+void GLES1_IndexedMesh::tipsify(int uniqueCount, int cacheSize)
+{
+    const int triangleCount = triangles.length() / 3;
+
+    // vertex to triangle adjacency, stored as offsets into a flat list
+    adjacencyOffsets.resize(uniqueCount + 1);
+    adjacencyOffsets.fill(0);
+    for (GLuint v : triangles) {
+        adjacencyOffsets[v + 1]++;
+    }
+    for (int v = 0; v < uniqueCount; v++) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+
+    liveTriangles.resize(uniqueCount);
+    cacheTime.resize(uniqueCount);
+    for (int v = 0; v < uniqueCount; v++) {
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+        // used as the fill cursor for the adjacency list, reset below
+        cacheTime[v] = adjacencyOffsets[v];
+    }
+    adjacency.resize(triangles.length());
+    for (int t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[cacheTime[triangles[t * 3 + k]]++] = t;
+        }
+    }
+    cacheTime.fill(0);
+
+    emitted.resize(triangleCount);
+    emitted.fill(false);
+    deadEnd.clear();
+    indices.clear();
+    indices.reserve(triangles.length());
+
+    int timestamp = cacheSize + 1;
+    int cursor = 1;
+    int fanning = uniqueCount > 0 ? 0 : -1;
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        // emit every remaining triangle around the fanning vertex
+        for (GLuint a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+            GLuint t = adjacency[a];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                GLuint v = triangles[t * 3 + k];
+                indices.append(v);
+                deadEnd.append(v);
+                candidates.append(v);
+                liveTriangles[v]--;
+                if (timestamp - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // prefer the candidate that will still be in the cache once its remaining triangles are emitted
+        fanning = -1;
+        int bestPriority = -1;
+        for (GLuint v : candidates) {
+            if (liveTriangles[v] <= 0) continue;
+            int priority = 0;
+            if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = timestamp - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning == -1) {
+            // dead end, back track through recently emitted vertices before scanning the rest in order
+            while (!deadEnd.isEmpty()) {
+                GLuint v = deadEnd.takeLast();
+                if (liveTriangles[v] > 0) {
+                    fanning = v;
+                    break;
+                }
+            }
+            while (fanning == -1 && cursor < uniqueCount) {
+                if (liveTriangles[cursor] > 0) {
+                    fanning = cursor;
+                }
+                cursor++;
+            }
+        }
+    }
+}
+
+void GLES1_IndexedMesh::reorderVertices(const GLES1_Vertex *vertexData)
+{
+    // remap is no longer needed once triangulated, reuse it as the unique to output vertex mapping
+    remap.resize(firstOccurrence.length());
+    remap.fill(emptySlot);
+    vertices.resize(firstOccurrence.length());
+
+    vertexCount = 0;
+    for (GLuint & index : indices) {
+        GLuint & target = remap[index];
+        if (target == emptySlot) {
+            target = vertexCount++;
+            vertices[target] = vertexData[firstOccurrence[index]];
+        }
+        index = target;
+    }
+    vertices.resize(vertexCount);
+}
+
+bool GLES1_IndexedMesh::build(GLenum mode, const GLES1_Vertex *vertexData, int vertexCount, int cacheSize)
+{
+    if (!canIndex(mode)) return false;
+    int unique = uniqueVertices(vertexData, vertexCount);
+    triangulate(mode, vertexCount);
+    tipsify(unique, cacheSize);
+    reorderVertices(vertexData);
+    return true;
+}
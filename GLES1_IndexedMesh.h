@@ -0,0 +1,46 @@
+#ifndef GLES1_INDEXEDMESH_H
+#define GLES1_INDEXEDMESH_H
+
+#include <QOpenGLFunctions>
+#include <QList>
+
+#include "GLES1_VertexArena.h"
+
+// merges bitwise equal vertices of a triangle block into a GL_TRIANGLES index buffer,
+// ordered with Tipsify (Sander, Nehab, Barczak 2007) for the post-transform vertex cache
+
+class GLES1_IndexedMesh
+{
+    QList<GLuint> remap;
+    QList<GLuint> firstOccurrence;
+    QList<GLuint> hashTable;
+    QList<GLuint> triangles;
+    QList<GLuint> adjacencyOffsets;
+    QList<GLuint> adjacency;
+    QList<int> liveTriangles;
+    QList<int> cacheTime;
+    QList<GLuint> deadEnd;
+    QList<GLuint> candidates;
+    QList<bool> emitted;
+
+    int uniqueVertices(const GLES1_Vertex * vertexData, int vertexCount);
+    void triangulate(GLenum mode, int vertexCount);
+    void tipsify(int uniqueCount, int cacheSize);
+    void reorderVertices(const GLES1_Vertex * vertexData);
+
+public:
+
+    // the number of vertices the post-transform cache is assumed to hold
+    static const int defaultCacheSize = 16;
+
+    QList<GLES1_Vertex> vertices;
+    QList<GLuint> indices;
+    int vertexCount = 0;
+
+    static bool canIndex(GLenum mode);
+
+    // returns false if the mode cannot be indexed, in which case the block must be drawn as submitted
+    bool build(GLenum mode, const GLES1_Vertex * vertexData, int vertexCount, int cacheSize = defaultCacheSize);
+};
+
+#endif // GLES1_INDEXEDMESH_H
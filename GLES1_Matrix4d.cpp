@@ -0,0 +1,113 @@
+#include "GLES1_Matrix4d.h"
+
+#include <QtMath>
+
+#include <cmath>
+
+GLES1_Matrix4d::GLES1_Matrix4d()
+{
+    setToIdentity();
+}
+
+GLES1_Matrix4d::GLES1_Matrix4d(const GLdouble *values)
+{
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            m[column * 4 + row] = values[row * 4 + column];
+        }
+    }
+}
+
+GLES1_Matrix4d::GLES1_Matrix4d(const QMatrix4x4 &matrix)
+{
+    const float * values = matrix.constData();
+    for (int i = 0; i < 16; i++) {
+        m[i] = values[i];
+    }
+}
+
+void GLES1_Matrix4d::setToIdentity()
+{
+    for (int i = 0; i < 16; i++) {
+        m[i] = i % 5 == 0 ? 1 : 0;
+    }
+}
+
+GLES1_Matrix4d GLES1_Matrix4d::transposed() const
+{
+    GLES1_Matrix4d result;
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            result.m[column * 4 + row] = m[row * 4 + column];
+        }
+    }
+    return result;
+}
+
+GLES1_Matrix4d operator*(const GLES1_Matrix4d &a, const GLES1_Matrix4d &b)
+{
+    GLES1_Matrix4d result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            result.m[column * 4 + row] = a.m[row] * b.m[column * 4]
+                    + a.m[4 + row] * b.m[column * 4 + 1]
+                    + a.m[8 + row] * b.m[column * 4 + 2]
+                    + a.m[12 + row] * b.m[column * 4 + 3];
+        }
+    }
+    return result;
+}
+
+GLES1_Matrix4d &GLES1_Matrix4d::operator*=(const GLES1_Matrix4d &other)
+{
+    *this = *this * other;
+    return *this;
+}
+
+void GLES1_Matrix4d::translate(GLdouble x, GLdouble y, GLdouble z)
+{
+    for (int row = 0; row < 4; row++) {
+        m[12 + row] += m[row] * x + m[4 + row] * y + m[8 + row] * z;
+    }
+}
+
+void GLES1_Matrix4d::scale(GLdouble x, GLdouble y, GLdouble z)
+{
+    for (int row = 0; row < 4; row++) {
+        m[row] *= x;
+        m[4 + row] *= y;
+        m[8 + row] *= z;
+    }
+}
+
+void GLES1_Matrix4d::rotate(GLdouble angle, GLdouble x, GLdouble y, GLdouble z)
+{
+    GLdouble length = std::sqrt(x * x + y * y + z * z);
+    if (length == 0) return;
+    x /= length;
+    y /= length;
+    z /= length;
+    GLdouble radians = qDegreesToRadians(angle);
+    GLdouble c = std::cos(radians);
+    GLdouble s = std::sin(radians);
+    GLdouble ic = 1 - c;
+
+    const GLdouble rows[16] = {
+        x * x * ic + c,     x * y * ic - z * s, x * z * ic + y * s, 0,
+        y * x * ic + z * s, y * y * ic + c,     y * z * ic - x * s, 0,
+        x * z * ic - y * s, y * z * ic + x * s, z * z * ic + c,     0,
+        0,                  0,                  0,                  1
+    };
+    *this *= GLES1_Matrix4d(rows);
+}
+
+QMatrix4x4 GLES1_Matrix4d::toMatrix4x4() const
+{
+    float values[16];
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            values[row * 4 + column] = static_cast<float>(m[column * 4 + row]);
+        }
+    }
+    return QMatrix4x4(values);
+}
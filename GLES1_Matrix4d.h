@@ -0,0 +1,34 @@
+#ifndef GLES1_MATRIX4D_H
+#define GLES1_MATRIX4D_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions>
+
+// the parts of QMatrix4x4 the matrix stacks use in double precision, with the same element order
+
+class GLES1_Matrix4d
+{
+    GLdouble m[16];
+
+public:
+
+    // identity
+    GLES1_Matrix4d();
+    explicit GLES1_Matrix4d(const GLdouble * values);
+    explicit GLES1_Matrix4d(const QMatrix4x4 & matrix);
+
+    void setToIdentity();
+    GLES1_Matrix4d transposed() const;
+
+    GLES1_Matrix4d & operator*=(const GLES1_Matrix4d & other);
+    friend GLES1_Matrix4d operator*(const GLES1_Matrix4d & a, const GLES1_Matrix4d & b);
+
+    void translate(GLdouble x, GLdouble y, GLdouble z);
+    void scale(GLdouble x, GLdouble y, GLdouble z);
+    // angle in degrees
+    void rotate(GLdouble angle, GLdouble x, GLdouble y, GLdouble z);
+
+    QMatrix4x4 toMatrix4x4() const;
+};
+
+#endif // GLES1_MATRIX4D_H
@@ -0,0 +1,108 @@
+#include "GLES1_MemoryAccounting.h"
+
+#include <QList>
+#include <QMutex>
+
+struct GLES1_Budget
+{
+    qint64 bytes = 0;
+    bool exceeded = false;
+    GLES1_MemoryAccounting::BudgetCallback callback;
+};
+
+static QMutex accountingMutex;
+static GLES1_MemoryAccounting::Usage usages[GLES1_MemoryAccounting::CategoryCount];
+static GLES1_Budget budgets[GLES1_MemoryAccounting::CategoryCount];
+
+static GLES1_MemoryAccounting::Category totalOf(GLES1_MemoryAccounting::Category category)
+{
+    return category >= GLES1_MemoryAccounting::Staging ? GLES1_MemoryAccounting::CpuTotal : GLES1_MemoryAccounting::GpuTotal;
+}
+
+// a callback to run once the lock is released
+struct GLES1_BudgetCrossing
+{
+    GLES1_MemoryAccounting::BudgetCallback callback;
+    GLES1_MemoryAccounting::Category category;
+    qint64 bytes;
+    qint64 budget;
+};
+
+static void update(GLES1_MemoryAccounting::Category category, qint64 bytes, int objects, QList<GLES1_BudgetCrossing> & crossings)
+{
+    GLES1_MemoryAccounting::Usage & usage = usages[category];
+    usage.bytes += bytes;
+    usage.objects += objects;
+    usage.peakBytes = qMax(usage.peakBytes, usage.bytes);
+
+    GLES1_Budget & budget = budgets[category];
+    if (budget.bytes == 0) return;
+    if (!budget.exceeded && usage.bytes > budget.bytes) {
+        budget.exceeded = true;
+        crossings.append({budget.callback, category, usage.bytes, budget.bytes});
+    } else if (budget.exceeded && usage.bytes <= budget.bytes) {
+        budget.exceeded = false;
+    }
+}
+
+static void change(GLES1_MemoryAccounting::Category category, qint64 bytes, int objects)
+{
+    Q_ASSERT(category < GLES1_MemoryAccounting::GpuTotal);
+    if (bytes == 0 && objects == 0) return;
+
+    QList<GLES1_BudgetCrossing> crossings;
+    {
+        QMutexLocker lock(&accountingMutex);
+        update(category, bytes, objects, crossings);
+        update(totalOf(category), bytes, objects, crossings);
+    }
+    // callbacks may query usage or free memory
+    for (const GLES1_BudgetCrossing & crossing : crossings) {
+        if (crossing.callback) crossing.callback(crossing.category, crossing.bytes, crossing.budget);
+    }
+}
+
+void GLES1_MemoryAccounting::allocate(Category category, qint64 bytes, int objects)
+{
+    change(category, bytes, objects);
+}
+
+void GLES1_MemoryAccounting::release(Category category, qint64 bytes, int objects)
+{
+    change(category, -bytes, -objects);
+}
+
+void GLES1_MemoryAccounting::resize(Category category, qint64 oldBytes, qint64 newBytes)
+{
+    change(category, newBytes - oldBytes, 0);
+}
+
+GLES1_MemoryAccounting::Usage GLES1_MemoryAccounting::usage(Category category)
+{
+    QMutexLocker lock(&accountingMutex);
+    return usages[category];
+}
+
+void GLES1_MemoryAccounting::resetPeaks()
+{
+    QMutexLocker lock(&accountingMutex);
+    for (Usage & usage : usages) {
+        usage.peakBytes = usage.bytes;
+    }
+}
+
+void GLES1_MemoryAccounting::setBudget(Category category, qint64 bytes, BudgetCallback callback)
+{
+    QMutexLocker lock(&accountingMutex);
+    GLES1_Budget & budget = budgets[category];
+    budget.bytes = bytes;
+    budget.callback = bytes > 0 ? callback : BudgetCallback();
+    // a budget set below the current usage reports on the next change
+    budget.exceeded = false;
+}
+
+qint64 GLES1_MemoryAccounting::budget(Category category)
+{
+    QMutexLocker lock(&accountingMutex);
+    return budgets[category].bytes;
+}
@@ -0,0 +1,56 @@
+#ifndef GLES1_MEMORYACCOUNTING_H
+#define GLES1_MEMORYACCOUNTING_H
+
+#include <QtGlobal>
+
+#include <functional>
+
+// live bytes, high water marks and object counts of what the wrappers of this process allocate
+//
+// gl sizes are as requested, the driver may round them up and keep orphaned storage alive longer,
+// budgets are soft, crossing one calls its callback on the allocating thread
+
+class GLES1_MemoryAccounting
+{
+public:
+
+    enum Category {
+        // gpu memory
+        Buffers,
+        Textures,
+        VertexArrays,
+        Programs,
+        // cpu memory
+        Staging,
+        Framebuffers,
+        // the sums of the categories above, can be queried and budgeted but not allocated from
+        GpuTotal,
+        CpuTotal,
+        CategoryCount
+    };
+
+    struct Usage {
+        qint64 bytes = 0;
+        qint64 peakBytes = 0;
+        qint64 objects = 0;
+    };
+
+    // called when the usage of category rises above budget, again only after it fell back
+    typedef std::function<void(Category category, qint64 bytes, qint64 budget)> BudgetCallback;
+
+    // objects is the change in the number of live objects
+    static void allocate(Category category, qint64 bytes, int objects = 0);
+    static void release(Category category, qint64 bytes, int objects = 0);
+    static void resize(Category category, qint64 oldBytes, qint64 newBytes);
+
+    static Usage usage(Category category);
+
+    // restarts every high water mark at the current usage
+    static void resetPeaks();
+
+    // a budget of 0 removes the budget of category
+    static void setBudget(Category category, qint64 bytes, BudgetCallback callback);
+    static qint64 budget(Category category);
+};
+
+#endif // GLES1_MEMORYACCOUNTING_H
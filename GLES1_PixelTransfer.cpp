@@ -0,0 +1,232 @@
+#include "GLES1_PixelTransfer.h"
+
+#include "GLES1_MemoryAccounting.h"
+
+#include <QDebug>
+
+#include <cstring>
+
+GLES1_PixelTransfer::GLES1_PixelTransfer(QOpenGLContext *context)
+{
+    // without a context, for the software rasterizer, nothing is ever transferred
+    gles2 = context != nullptr ? context->functions() : nullptr;
+    gles3 = context != nullptr ? context->extraFunctions() : nullptr;
+}
+
+GLES1_PixelTransfer::~GLES1_PixelTransfer()
+{
+    for (Upload & upload : uploads) {
+        if (upload.texture != 0) {
+            GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Textures, upload.textureBytes, 1);
+            gles2->glDeleteTextures(1, &upload.texture);
+        }
+        if (upload.buffer != 0) {
+            GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Buffers, upload.capacity, 1);
+            gles2->glDeleteBuffers(1, &upload.buffer);
+        }
+    }
+    for (Read & read : reads) {
+        if (read.fence != nullptr) {
+            gles3->glDeleteSync(read.fence);
+        }
+        GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Buffers, read.capacity, 1);
+        gles2->glDeleteBuffers(1, &read.buffer);
+    }
+}
+
+int GLES1_PixelTransfer::pixelSize(GLenum format, GLenum type)
+{
+    int components;
+    switch (format) {
+    case GL_RGB:
+        components = 3;
+        break;
+    case GL_RGBA:
+        components = 4;
+        break;
+    default:
+        return 0;
+    }
+    switch (type) {
+    case GL_UNSIGNED_BYTE:
+        return components;
+    case GL_FLOAT:
+        return components * sizeof(GLfloat);
+    default:
+        return 0;
+    }
+}
+
+GLenum GLES1_PixelTransfer::textureFormat(GLenum format, GLenum type)
+{
+    if (pixelSize(format, type) == 0) return 0;
+    if (type == GL_FLOAT) {
+        return format == GL_RGBA ? GL_RGBA32F : GL_RGB32F;
+    }
+    return format == GL_RGBA ? GL_RGBA8 : GL_RGB8;
+}
+
+GLsizeiptr GLES1_PixelTransfer::imageSize(GLenum alignmentParameter, GLenum rowLengthParameter, GLsizei width, GLsizei height, int pixelSize)
+{
+    GLint alignment = 4;
+    GLint rowLength = 0;
+    gles2->glGetIntegerv(alignmentParameter, &alignment);
+    gles2->glGetIntegerv(rowLengthParameter, &rowLength);
+    GLsizeiptr rowBytes = static_cast<GLsizeiptr>(rowLength > 0 ? rowLength : width) * pixelSize;
+    rowBytes = (rowBytes + alignment - 1) / alignment * alignment;
+    // the last row is not padded
+    return rowBytes * (height - 1) + static_cast<GLsizeiptr>(width) * pixelSize;
+}
+
+GLuint GLES1_PixelTransfer::upload(GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels)
+{
+    GLenum internalFormat = textureFormat(format, type);
+    if (internalFormat == 0 || width <= 0 || height <= 0) return 0;
+    GLsizeiptr size = imageSize(GL_UNPACK_ALIGNMENT, GL_UNPACK_ROW_LENGTH, width, height, pixelSize(format, type));
+
+    Upload & slot = uploads[nextUpload];
+    nextUpload = (nextUpload + 1) % uploadCount;
+
+    // the storage is (re)specified before the unpack buffer is bound, which would make it read from the buffer
+    if (slot.texture == 0) {
+        gles2->glGenTextures(1, &slot.texture);
+        gles2->glBindTexture(GL_TEXTURE_2D, slot.texture);
+        // texelFetch needs a complete texture, which a texture without mipmaps is only when not minified through them
+        gles2->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        gles2->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Textures, 0, 1);
+    } else {
+        gles2->glBindTexture(GL_TEXTURE_2D, slot.texture);
+    }
+    if (slot.width != width || slot.height != height || slot.internalFormat != internalFormat) {
+        gles2->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        qint64 textureBytes = static_cast<qint64>(width) * height * pixelSize(format, type);
+        GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Textures, slot.textureBytes, textureBytes);
+        slot.width = width;
+        slot.height = height;
+        slot.internalFormat = internalFormat;
+        slot.textureBytes = textureBytes;
+    }
+
+    if (slot.buffer == 0) {
+        gles2->glGenBuffers(1, &slot.buffer);
+        GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Buffers, 0, 1);
+    }
+    gles2->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    // orphan the storage, a transfer from the previous contents may still be pending
+    GLsizeiptr capacity = qMax(slot.capacity, size);
+    gles2->glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+    GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Buffers, slot.capacity, capacity);
+    slot.capacity = capacity;
+    void * destination = gles3->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (destination == nullptr) {
+        qWarning() << "GLES1_Wrapper: mapping a pixel upload failed, uploading from client memory";
+        gles2->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        gles2->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, pixels);
+        return slot.texture;
+    }
+    memcpy(destination, pixels, size);
+    gles3->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    gles2->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, nullptr);
+    gles2->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return slot.texture;
+}
+
+GLES1_PixelTransfer::Read *GLES1_PixelTransfer::findRead(quint32 handle)
+{
+    if (handle == 0) return nullptr;
+    for (Read & read : reads) {
+        if (read.handle == handle) return &read;
+    }
+    return nullptr;
+}
+
+quint32 GLES1_PixelTransfer::startRead(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+    int pixel = pixelSize(format, type);
+    if (pixel == 0 || width <= 0 || height <= 0) return 0;
+    GLsizeiptr size = imageSize(GL_PACK_ALIGNMENT, GL_PACK_ROW_LENGTH, width, height, pixel);
+
+    // prefer a free buffer that is already large enough
+    Read * read = nullptr;
+    for (Read & candidate : reads) {
+        if (candidate.handle != 0) continue;
+        if (read == nullptr || (read->capacity < size && candidate.capacity >= size)) {
+            read = &candidate;
+        }
+    }
+    if (read == nullptr) {
+        reads.append(Read());
+        read = &reads.last();
+        gles2->glGenBuffers(1, &read->buffer);
+        GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Buffers, 0, 1);
+    }
+
+    gles2->glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer);
+    if (read->capacity < size) {
+        gles2->glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Buffers, read->capacity, size);
+        read->capacity = size;
+    }
+    gles2->glReadPixels(x, y, width, height, format, type, nullptr);
+    gles2->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    read->fence = gles3->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    read->size = size;
+    read->handle = nextHandle++;
+    if (nextHandle == 0) {
+        nextHandle = 1;
+    }
+    return read->handle;
+}
+
+bool GLES1_PixelTransfer::isReadComplete(quint32 handle)
+{
+    Read * read = findRead(handle);
+    if (read == nullptr) return false;
+    if (read->fence != nullptr) {
+        // a timeout of 0 only polls, the flush bit makes sure the fence gets to the gpu and eventually signals
+        GLenum status = gles3->glClientWaitSync(read->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+        gles3->glDeleteSync(read->fence);
+        read->fence = nullptr;
+    }
+    return true;
+}
+
+GLsizeiptr GLES1_PixelTransfer::readSize(quint32 handle)
+{
+    Read * read = findRead(handle);
+    return read != nullptr ? read->size : 0;
+}
+
+bool GLES1_PixelTransfer::takeRead(quint32 handle, void *data)
+{
+    if (!isReadComplete(handle)) return false;
+    Read * read = findRead(handle);
+
+    gles2->glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer);
+    const void * source = gles3->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, read->size, GL_MAP_READ_BIT);
+    bool mapped = source != nullptr;
+    if (mapped) {
+        memcpy(data, source, read->size);
+        gles3->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        qWarning() << "GLES1_Wrapper: mapping read pixels failed";
+    }
+    gles2->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    read->handle = 0;
+    return mapped;
+}
+
+void GLES1_PixelTransfer::cancelRead(quint32 handle)
+{
+    Read * read = findRead(handle);
+    if (read == nullptr) return;
+    if (read->fence != nullptr) {
+        gles3->glDeleteSync(read->fence);
+        read->fence = nullptr;
+    }
+    read->handle = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef GLES1_PIXELTRANSFER_H
+#define GLES1_PIXELTRANSFER_H
+
+#include <QList>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions>
+
+// pooled pixel buffers and textures moving pixels to and from the gpu without stalling,
+// uploads rotate through uploadCount textures, reads are fenced and only mapped once complete
+//
+// the pixel store alignment and row length are honoured, skipped pixels and rows are not
+
+class GLES1_PixelTransfer
+{
+    struct Upload {
+        GLuint texture = 0;
+        GLuint buffer = 0;
+        GLsizeiptr capacity = 0;
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLenum internalFormat = 0;
+        qint64 textureBytes = 0;
+    };
+
+    struct Read {
+        // 0 while the buffer is free
+        quint32 handle = 0;
+        GLuint buffer = 0;
+        GLsizeiptr capacity = 0;
+        GLsizeiptr size = 0;
+        GLsync fence = nullptr;
+    };
+
+    QOpenGLFunctions * gles2;
+    QOpenGLExtraFunctions * gles3;
+
+public:
+
+    static const int uploadCount = 3;
+
+private:
+
+    Upload uploads[uploadCount];
+    int nextUpload = 0;
+
+    QList<Read> reads;
+    quint32 nextHandle = 1;
+
+    Read * findRead(quint32 handle);
+    GLsizeiptr imageSize(GLenum alignmentParameter, GLenum rowLengthParameter, GLsizei width, GLsizei height, int pixelSize);
+
+public:
+
+    // no GL calls are made until the first transfer
+    GLES1_PixelTransfer(QOpenGLContext * context);
+    GLES1_PixelTransfer(const GLES1_PixelTransfer &) = delete;
+    GLES1_PixelTransfer & operator=(const GLES1_PixelTransfer &) = delete;
+
+    // the context must be current
+    ~GLES1_PixelTransfer();
+
+    // GL_RGB and GL_RGBA of GL_UNSIGNED_BYTE or GL_FLOAT, 0 for anything else
+    static int pixelSize(GLenum format, GLenum type);
+    static GLenum textureFormat(GLenum format, GLenum type);
+
+    // returns the texture now holding the pixels, left bound to GL_TEXTURE_2D, or 0 if the format is not supported
+    GLuint upload(GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels);
+
+    // starts reading pixels of the read framebuffer, returns 0 if the format is not supported
+    quint32 startRead(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type);
+
+    // never waits for the gpu
+    bool isReadComplete(quint32 handle);
+
+    // the bytes takeRead copies, laid out as glReadPixels would with the pack parameters of startRead
+    GLsizeiptr readSize(quint32 handle);
+
+    // copies the pixels of a complete read into data and frees its handle, returns false if the read is not complete
+    bool takeRead(quint32 handle, void * data);
+    void cancelRead(quint32 handle);
+};
+
+#endif // GLES1_PIXELTRANSFER_H
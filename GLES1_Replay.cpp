@@ -0,0 +1,205 @@
+// replays a trace recorded with GLES1_Wrapper::startCapture against a headless context
+// and reports the cpu and gpu time of every frame
+//
+// with --software every frame is also replayed into a GLES1_SoftwareRasterizer and the two images are
+// compared instead, the exit code is 1 when a frame differs by more than the tolerance below
+//
+// usage: GLES1_Replay [--software] <trace> [width height]
+
+#include "GLES1_Wrapper.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QImage>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+// a pixel differs when a channel is further apart than this, edges may round differently on every gpu
+static const int channelTolerance = 8;
+// and a frame when more than this fraction of its pixels differ
+static const double pixelTolerance = 0.001;
+
+// replays the trace into the framebuffer and the rasterizer frame by frame and prints how far they differ
+static int compareSoftware(const uchar * data, qint64 size, QOpenGLContext * context, int width, int height)
+{
+    QOpenGLExtraFunctions * gles3 = context->extraFunctions();
+    GLES1_TraceReader glReader(data, size);
+    GLES1_TraceReader softwareReader(data, size);
+
+    // the rasterizer starts out cleared to zero
+    gles3->glClearColor(0, 0, 0, 0);
+    gles3->glClearDepthf(1);
+    gles3->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    GLES1_SoftwareRasterizer rasterizer(width, height);
+    GLES1_Wrapper glWrapper(context);
+    GLES1_Wrapper softwareWrapper(&rasterizer);
+
+    QImage rendered(width, height, QImage::Format_RGBA8888);
+    const qint64 pixels = qint64(width) * height;
+    int failed = 0;
+    int frame = 0;
+    printf("frame\tmax diff\tmean diff\tpixels differing\n");
+    while (!glReader.atEnd()) {
+        bool replayed = glReader.replayFrame(glWrapper);
+        if (!softwareReader.replayFrame(softwareWrapper)) replayed = false;
+
+        // rows of an RGBA8888 image are packed, they come back bottom up
+        gles3->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        gles3->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rendered.bits());
+        const QImage expected = rasterizer.image();
+
+        int maxDiff = 0;
+        quint64 sumDiff = 0;
+        qint64 differing = 0;
+        for (int y = 0; y < height; y++) {
+            const uchar * a = rendered.constScanLine(height - 1 - y);
+            const uchar * b = expected.constScanLine(y);
+            for (int x = 0; x < width * 4; x += 4) {
+                int pixelDiff = 0;
+                for (int k = 0; k < 4; k++) {
+                    pixelDiff = qMax(pixelDiff, qAbs(int(a[x + k]) - int(b[x + k])));
+                }
+                maxDiff = qMax(maxDiff, pixelDiff);
+                sumDiff += pixelDiff;
+                if (pixelDiff > channelTolerance) differing++;
+            }
+        }
+        printf("%d\t%d\t%.3f\t%lld\n", frame, maxDiff, pixels > 0 ? double(sumDiff) / pixels : 0.0,
+               static_cast<long long>(differing));
+        if (differing > pixels * pixelTolerance) failed++;
+        frame++;
+        if (!replayed) break;
+    }
+    printf("%d of %d frames differ\n", failed, frame);
+    return failed == 0 && glReader.isValid() && softwareReader.isValid() ? 0 : 1;
+}
+
+int main(int argc, char ** argv)
+{
+    QGuiApplication app(argc, argv);
+
+    const char * program = argv[0];
+    bool software = argc > 1 && strcmp(argv[1], "--software") == 0;
+    if (software) {
+        argc--;
+        argv++;
+    }
+    if (argc != 2 && argc != 4) {
+        fprintf(stderr, "usage: %s [--software] <trace> [width height]\n", program);
+        return 2;
+    }
+    int width = argc == 4 ? atoi(argv[2]) : 1920;
+    int height = argc == 4 ? atoi(argv[3]) : 1080;
+
+    QFile file(QString::fromLocal8Bit(argv[1]));
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    const uchar * data = file.map(0, file.size());
+    if (data == nullptr) {
+        fprintf(stderr, "cannot map %s\n", argv[1]);
+        return 1;
+    }
+    GLES1_TraceReader reader(data, file.size());
+    if (!reader.isValid()) {
+        fprintf(stderr, "%s is not a GLES1_Wrapper trace\n", argv[1]);
+        return 1;
+    }
+
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create() || !context.makeCurrent(&surface)) {
+        fprintf(stderr, "cannot create an OpenGL context\n");
+        return 1;
+    }
+    QOpenGLExtraFunctions * gles3 = context.extraFunctions();
+
+    QOpenGLFramebufferObject framebuffer(width, height, QOpenGLFramebufferObject::CombinedDepthStencil);
+    framebuffer.bind();
+    gles3->glViewport(0, 0, width, height);
+
+    if (software) {
+        int result = compareSoftware(data, file.size(), &context, width, height);
+        framebuffer.release();
+        context.doneCurrent();
+        return result;
+    }
+
+    // timer queries are core in desktop GL 3.3, ES needs GL_EXT_disjoint_timer_query
+    bool gpuTiming = !context.isOpenGLES() || context.hasExtension(QByteArrayLiteral("GL_EXT_disjoint_timer_query"));
+
+    QList<GLuint> queries;
+    QList<qint64> cpuTimes;
+
+    {
+        GLES1_Wrapper wrapper(&context);
+        QElapsedTimer timer;
+        while (!reader.atEnd()) {
+            GLuint query = 0;
+            if (gpuTiming) {
+                gles3->glGenQueries(1, &query);
+                gles3->glBeginQuery(GL_TIME_ELAPSED, query);
+            }
+            timer.start();
+            bool replayed = reader.replayFrame(wrapper);
+            cpuTimes.append(timer.nsecsElapsed());
+            if (gpuTiming) {
+                gles3->glEndQuery(GL_TIME_ELAPSED);
+                queries.append(query);
+            }
+            if (!replayed) break;
+        }
+        // results are only read back once everything was submitted so the replay never waits on the gpu
+        gles3->glFinish();
+    }
+
+    qint64 cpuTotal = 0;
+    quint64 gpuTotal = 0;
+    printf("frame\tcpu ms\tgpu ms\n");
+    for (int i = 0; i < cpuTimes.length(); i++) {
+        cpuTotal += cpuTimes[i];
+        if (gpuTiming) {
+            GLuint elapsed = 0;
+            gles3->glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &elapsed);
+            gpuTotal += elapsed;
+            printf("%d\t%.3f\t%.3f\n", i, cpuTimes[i] / 1e6, elapsed / 1e6);
+        } else {
+            printf("%d\t%.3f\t-\n", i, cpuTimes[i] / 1e6);
+        }
+    }
+    if (gpuTiming && !queries.isEmpty()) {
+        gles3->glDeleteQueries(queries.length(), queries.data());
+    }
+
+    int frames = qMax(1, static_cast<int>(cpuTimes.length()));
+    if (gpuTiming) {
+        printf("total\t%.3f\t%.3f\n", cpuTotal / 1e6, gpuTotal / 1e6);
+        printf("mean\t%.3f\t%.3f\n", cpuTotal / 1e6 / frames, gpuTotal / 1e6 / frames);
+    } else {
+        printf("total\t%.3f\t-\n", cpuTotal / 1e6);
+        printf("mean\t%.3f\t-\n", cpuTotal / 1e6 / frames);
+    }
+
+    framebuffer.release();
+    context.doneCurrent();
+    return reader.isValid() ? 0 : 1;
+}
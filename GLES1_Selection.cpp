@@ -0,0 +1,396 @@
+#include "GLES1_Selection.h"
+
+#include <QDebug>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+void GLES1_Selection::setBuffer(GLuint *buffer, GLsizei size)
+{
+    this->buffer = buffer;
+    bufferSize = size;
+}
+
+void GLES1_Selection::begin()
+{
+    nameStack.clear();
+    segmentNames.clear();
+    segmentStarts.clear();
+    startSegment();
+    projections.clear();
+    matchedBlocks = 0;
+    diverged = false;
+}
+
+void GLES1_Selection::startSegment()
+{
+    segmentStarts.append(segmentNames.length());
+    segmentNames.append(nameStack);
+}
+
+void GLES1_Selection::initNames()
+{
+    nameStack.clear();
+    startSegment();
+}
+
+void GLES1_Selection::pushName(GLuint name)
+{
+    nameStack.append(name);
+    startSegment();
+}
+
+void GLES1_Selection::popName()
+{
+    if (nameStack.isEmpty()) return;
+    nameStack.removeLast();
+    startSegment();
+}
+
+void GLES1_Selection::loadName(GLuint name)
+{
+    if (nameStack.isEmpty()) return;
+    nameStack.last() = name;
+    startSegment();
+}
+
+void GLES1_Selection::diverge()
+{
+    // everything from the first difference on is recorded again
+    diverged = true;
+    blocks.resize(matchedBlocks);
+    if (blocks.isEmpty()) {
+        positions.clear();
+        modelViews.clear();
+    } else {
+        positions.resize(blocks.last().firstVertex + blocks.last().vertexCount);
+        modelViews.resize(blocks.last().modelView + 1);
+    }
+}
+
+void GLES1_Selection::addBlock(GLenum mode, const GLES1_Vertex *vertices, int vertexCount, const QMatrix4x4 &modelView, const QMatrix4x4 &projection)
+{
+    if (vertexCount == 0) return;
+
+    if (projections.isEmpty() || projections.last() != projection) {
+        projections.append(projection);
+    }
+    Block block;
+    block.mode = mode;
+    block.vertexCount = vertexCount;
+    block.projection = projections.length() - 1;
+    block.segment = segmentStarts.length() - 1;
+
+    if (!diverged) {
+        if (matchedBlocks < blocks.length()) {
+            const Block & previous = blocks[matchedBlocks];
+            bool same = previous.mode == mode
+                    && previous.vertexCount == vertexCount
+                    && previous.projection == block.projection
+                    && previous.segment == block.segment
+                    && modelViews[previous.modelView] == modelView;
+            const QVector4D * position = positions.constData() + previous.firstVertex;
+            for (int v = 0; same && v < vertexCount; v++) {
+                same = position[v].x() == vertices[v].x
+                        && position[v].y() == vertices[v].y
+                        && position[v].z() == vertices[v].z
+                        && position[v].w() == vertices[v].w;
+            }
+            if (same) {
+                matchedBlocks++;
+                return;
+            }
+        }
+        diverge();
+    }
+
+    if (modelViews.isEmpty() || modelViews.last() != modelView) {
+        modelViews.append(modelView);
+    }
+    block.modelView = modelViews.length() - 1;
+    block.firstVertex = positions.length();
+    for (int v = 0; v < vertexCount; v++) {
+        positions.append(QVector4D(vertices[v].x, vertices[v].y, vertices[v].z, vertices[v].w));
+    }
+    blocks.append(block);
+}
+
+void GLES1_Selection::addPrimitive(const QVector3D *vertices, int vertexCount, int segment)
+{
+    Primitive primitive;
+    QVector3D sum;
+    for (int v = 0; v < 3; v++) {
+        primitive.vertices[v] = vertices[qMin(v, vertexCount - 1)];
+    }
+    for (int v = 0; v < vertexCount; v++) {
+        sum += vertices[v];
+    }
+    primitive.centroid = sum / vertexCount;
+    primitive.vertexCount = vertexCount;
+    primitive.segment = segment;
+    primitives.append(primitive);
+}
+
+void GLES1_Selection::rebuild()
+{
+    primitives.clear();
+    nodes.clear();
+    roots.fill(-1, projections.length());
+
+    // a new projection index is only ever appended, so the primitives of a projection are contiguous
+    int projection = 0;
+    int projectionFirst = 0;
+    auto buildHierarchy = [this, &projection, &projectionFirst]() {
+        int count = primitives.length() - projectionFirst;
+        if (count == 0) return;
+        roots[projection] = nodes.length();
+        nodes.append(Node());
+        buildNode(roots[projection], projectionFirst, count);
+    };
+
+    QList<QVector3D> eye;
+    for (const Block & block : blocks) {
+        if (block.projection != projection) {
+            buildHierarchy();
+            projection = block.projection;
+            projectionFirst = primitives.length();
+        }
+
+        const QMatrix4x4 & modelView = modelViews[block.modelView];
+        eye.resize(block.vertexCount);
+        for (int v = 0; v < block.vertexCount; v++) {
+            eye[v] = (modelView * positions[block.firstVertex + v]).toVector3DAffine();
+        }
+        const QVector3D * e = eye.constData();
+        int n = block.vertexCount;
+        int s = block.segment;
+        auto triangle = [this, e, s](int a, int b, int c) {
+            const QVector3D vertices[] = {e[a], e[b], e[c]};
+            addPrimitive(vertices, 3, s);
+        };
+
+        switch (block.mode) {
+        case GL_POINTS:
+            for (int v = 0; v < n; v++) addPrimitive(e + v, 1, s);
+            break;
+        case GL_LINES:
+            for (int v = 0; v + 1 < n; v += 2) addPrimitive(e + v, 2, s);
+            break;
+        case GL_LINE_LOOP:
+            if (n > 2) {
+                const QVector3D closing[] = {e[n - 1], e[0]};
+                addPrimitive(closing, 2, s);
+            }
+            // fall through
+        case GL_LINE_STRIP:
+            for (int v = 0; v + 1 < n; v++) addPrimitive(e + v, 2, s);
+            break;
+        case GL_TRIANGLES:
+            for (int v = 0; v + 2 < n; v += 3) addPrimitive(e + v, 3, s);
+            break;
+        case GL_TRIANGLE_STRIP:
+            for (int v = 0; v + 2 < n; v++) addPrimitive(e + v, 3, s);
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            for (int v = 1; v + 1 < n; v++) triangle(0, v, v + 1);
+            break;
+        case GL_QUADS:
+            for (int v = 0; v + 3 < n; v += 4) {
+                triangle(v, v + 1, v + 2);
+                triangle(v, v + 2, v + 3);
+            }
+            break;
+        case GL_QUAD_STRIP:
+            for (int v = 0; v + 3 < n; v += 2) {
+                triangle(v, v + 1, v + 3);
+                triangle(v, v + 3, v + 2);
+            }
+            break;
+        default:
+            qWarning() << "GLES1_Wrapper: selection ignores primitive mode" << block.mode;
+        }
+    }
+    buildHierarchy();
+    built = true;
+}
+
+void GLES1_Selection::buildNode(int node, int first, int count)
+{
+    QVector3D min = primitives[first].vertices[0];
+    QVector3D max = min;
+    QVector3D centroidMin = primitives[first].centroid;
+    QVector3D centroidMax = centroidMin;
+    for (int p = first; p < first + count; p++) {
+        const Primitive & primitive = primitives[p];
+        for (int v = 0; v < primitive.vertexCount; v++) {
+            for (int axis = 0; axis < 3; axis++) {
+                min[axis] = qMin(min[axis], primitive.vertices[v][axis]);
+                max[axis] = qMax(max[axis], primitive.vertices[v][axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            centroidMin[axis] = qMin(centroidMin[axis], primitive.centroid[axis]);
+            centroidMax[axis] = qMax(centroidMax[axis], primitive.centroid[axis]);
+        }
+    }
+    nodes[node].min = min;
+    nodes[node].max = max;
+
+    if (count <= leafSize) {
+        nodes[node].first = first;
+        nodes[node].count = count;
+        return;
+    }
+
+    // median split along the longest extent of the centroids
+    QVector3D extent = centroidMax - centroidMin;
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    int half = count / 2;
+    std::nth_element(primitives.begin() + first, primitives.begin() + first + half, primitives.begin() + first + count,
+                     [axis](const Primitive & a, const Primitive & b) {
+        return a.centroid[axis] < b.centroid[axis];
+    });
+
+    int children = nodes.length();
+    nodes.append(Node());
+    nodes.append(Node());
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    buildNode(children, first, half);
+    buildNode(children + 1, first + half, count - half);
+}
+
+void GLES1_Selection::query(int root, const QMatrix4x4 &projection)
+{
+    // the view volume in eye space, a point is inside where every plane is >= 0
+    QVector4D x = projection.row(0);
+    QVector4D y = projection.row(1);
+    QVector4D z = projection.row(2);
+    QVector4D w = projection.row(3);
+    const QVector4D planes[6] = {w + x, w - x, w + y, w - y, w + z, w - z};
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(root);
+    while (!stack.isEmpty()) {
+        const Node & node = nodes[stack.last()];
+        stack.removeLast();
+
+        bool outside = false;
+        for (const QVector4D & plane : planes) {
+            // the corner furthest along the plane normal
+            QVector3D corner(plane.x() >= 0 ? node.max.x() : node.min.x(),
+                             plane.y() >= 0 ? node.max.y() : node.min.y(),
+                             plane.z() >= 0 ? node.max.z() : node.min.z());
+            if (QVector3D::dotProduct(plane.toVector3D(), corner) + plane.w() < 0) {
+                outside = true;
+                break;
+            }
+        }
+        if (outside) continue;
+
+        if (node.count == 0) {
+            stack.append(node.first);
+            stack.append(node.first + 1);
+        } else {
+            for (int p = node.first; p < node.first + node.count; p++) {
+                hitPrimitive(primitives[p], projection);
+            }
+        }
+    }
+}
+
+// the distance of a clip space point to the plane of the view volume, inside where >= 0
+static inline GLfloat planeDistance(const QVector4D & v, int plane)
+{
+    switch (plane) {
+    case 0: return v.w() + v.x();
+    case 1: return v.w() - v.x();
+    case 2: return v.w() + v.y();
+    case 3: return v.w() - v.y();
+    case 4: return v.w() + v.z();
+    default: return v.w() - v.z();
+    }
+}
+
+void GLES1_Selection::hitPrimitive(const Primitive &primitive, const QMatrix4x4 &projection)
+{
+    // clip the primitive to the view volume, points and lines clip as degenerate polygons
+    QVector4D polygon[16];
+    QVector4D clipped[16];
+    int count = primitive.vertexCount;
+    for (int v = 0; v < count; v++) {
+        polygon[v] = projection * QVector4D(primitive.vertices[v], 1);
+    }
+    for (int plane = 0; plane < 6 && count > 0; plane++) {
+        int out = 0;
+        for (int v = 0; v < count; v++) {
+            const QVector4D & a = polygon[v];
+            const QVector4D & b = polygon[(v + 1) % count];
+            GLfloat da = planeDistance(a, plane);
+            GLfloat db = planeDistance(b, plane);
+            if (da >= 0) clipped[out++] = a;
+            if ((da >= 0) != (db >= 0)) clipped[out++] = a + (b - a) * (da / (da - db));
+        }
+        count = out;
+        std::copy(clipped, clipped + count, polygon);
+    }
+    if (count == 0) return;
+
+    int s = primitive.segment;
+    for (int v = 0; v < count; v++) {
+        GLfloat depth = polygon[v].z() / polygon[v].w();
+        if (!hits[s]) {
+            hits[s] = true;
+            minDepths[s] = depth;
+            maxDepths[s] = depth;
+        } else {
+            minDepths[s] = qMin(minDepths[s], depth);
+            maxDepths[s] = qMax(maxDepths[s], depth);
+        }
+    }
+}
+
+// normalized device depth to the unsigned window depth of a hit record
+static GLuint windowDepth(GLfloat depth)
+{
+    return static_cast<GLuint>(qBound(0.0, (depth + 1.0) / 2.0, 1.0) * 4294967295.0);
+}
+
+GLint GLES1_Selection::end()
+{
+    if (!diverged && matchedBlocks < blocks.length()) {
+        diverge();
+    }
+    // segment names are read when writing records, only the blocks shape the hierarchy
+    if (diverged || !built) {
+        rebuild();
+    }
+
+    hits.fill(false, segmentStarts.length());
+    minDepths.resize(segmentStarts.length());
+    maxDepths.resize(segmentStarts.length());
+    for (int projection = 0; projection < roots.length(); projection++) {
+        if (roots[projection] >= 0) {
+            query(roots[projection], projections[projection]);
+        }
+    }
+
+    // records follow the order in which the name stack changed
+    GLint records = 0;
+    GLsizei written = 0;
+    for (int s = 0; s < segmentStarts.length(); s++) {
+        if (!hits[s]) continue;
+        int first = segmentStarts[s];
+        int count = (s + 1 < segmentStarts.length() ? segmentStarts[s + 1] : segmentNames.length()) - first;
+        if (written + 3 + count > bufferSize) return -1;
+        buffer[written++] = count;
+        buffer[written++] = windowDepth(minDepths[s]);
+        buffer[written++] = windowDepth(maxDepths[s]);
+        for (int n = 0; n < count; n++) {
+            buffer[written++] = segmentNames[first + n];
+        }
+        records++;
+    }
+    return records;
+}
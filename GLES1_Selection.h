@@ -0,0 +1,103 @@
+#ifndef GLES1_SELECTION_H
+#define GLES1_SELECTION_H
+
+#include <QList>
+#include <QMatrix4x4>
+#include <QOpenGLFunctions>
+#include <QVector3D>
+#include <QVector4D>
+
+#include "GLES1_VertexArena.h"
+
+// GL_SELECT emulation, the blocks of a pass are intersected with the view volume through a bounding volume
+// hierarchy, which is kept while a pass repeats the blocks, modelviews and names of the previous one
+//
+// hit depths are window depths for the default depth range, the name stack is not limited in depth
+
+class GLES1_Selection
+{
+    struct Block {
+        GLenum mode;
+        int firstVertex;
+        int vertexCount;
+        // indices into modelViews, projections and segmentStarts
+        int modelView;
+        int projection;
+        int segment;
+    };
+
+    // points and lines repeat their last vertex
+    struct Primitive {
+        QVector3D vertices[3];
+        QVector3D centroid;
+        int vertexCount;
+        int segment;
+    };
+
+    struct Node {
+        QVector3D min;
+        QVector3D max;
+        // an inner node has count 0 and its children at first and first + 1, a leaf holds primitives first to first + count
+        int first;
+        int count;
+    };
+
+    GLuint * buffer = nullptr;
+    GLsizei bufferSize = 0;
+
+    QList<GLuint> nameStack;
+
+    // a segment holds the primitives submitted between two changes of the name stack,
+    // its names start at segmentStarts[segment] in segmentNames
+    QList<GLuint> segmentNames;
+    QList<int> segmentStarts;
+
+    // the blocks of the pass, the leading ones are those of the previous pass until the first difference
+    QList<Block> blocks;
+    QList<QVector4D> positions;
+    QList<QMatrix4x4> modelViews;
+    QList<QMatrix4x4> projections;
+    int matchedBlocks = 0;
+    bool diverged = false;
+
+    // the hierarchy of every projection, -1 if nothing was submitted with it
+    QList<Primitive> primitives;
+    QList<Node> nodes;
+    QList<int> roots;
+    bool built = false;
+
+    // per segment
+    QList<bool> hits;
+    QList<GLfloat> minDepths;
+    QList<GLfloat> maxDepths;
+
+    void startSegment();
+    void diverge();
+    void addPrimitive(const QVector3D * vertices, int vertexCount, int segment);
+    void rebuild();
+    void buildNode(int node, int first, int count);
+    void query(int root, const QMatrix4x4 & projection);
+    void hitPrimitive(const Primitive & primitive, const QMatrix4x4 & projection);
+
+public:
+
+    static const int leafSize = 4;
+
+    void setBuffer(GLuint * buffer, GLsizei size);
+
+    // starts recording a pass
+    void begin();
+
+    // finds the hits of the pass and writes their records to the buffer, returns the number of records
+    // or -1 if they did not fit
+    GLint end();
+
+    void initNames();
+    void pushName(GLuint name);
+    void popName();
+    void loadName(GLuint name);
+
+    void addBlock(GLenum mode, const GLES1_Vertex * vertices, int vertexCount, const QMatrix4x4 & modelView, const QMatrix4x4 & projection);
+};
+
+#endif // GLES1_SELECTION_H
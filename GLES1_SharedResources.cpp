@@ -0,0 +1,428 @@
+#include "GLES1_SharedResources.h"
+
+#include "GLES1_MemoryAccounting.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QOpenGLExtraFunctions>
+#include <QOffscreenSurface>
+#include <QThread>
+#include <QWaitCondition>
+
+const char * GLES1_SharedResources::vertex_shader = R"(
+layout (location = 0) in vec4 vertex_position;
+layout (location = 1) in vec4 vertex_color;
+uniform mat4 projection;
+#ifdef MATRIX_ARRAY
+layout (location = 2) in uint vertex_matrix;
+layout (std140) uniform ModelViews {
+    mat4 modelViews[MODELVIEW_ARRAY_SIZE];
+};
+#else
+uniform mat4 modelView;
+#endif
+uniform vec3 normal;
+
+out vec4 fragment_in_color;
+
+void main()
+{
+#ifdef MATRIX_ARRAY
+    gl_Position = projection * modelViews[vertex_matrix] * vertex_position;
+#else
+    gl_Position = projection * modelView * vertex_position;
+#endif
+    fragment_in_color = vertex_color;
+}
+)";
+
+const char * GLES1_SharedResources::fragment_shader = R"(
+// input
+in highp vec4 fragment_in_color;
+
+// output
+out highp vec4 FragColor;
+
+// code
+void main() {
+    FragColor = fragment_in_color;
+}
+)";
+
+const char * GLES1_SharedResources::pixels_vertex_shader = R"(
+layout (location = 0) in vec4 vertex_position;
+
+void main()
+{
+    gl_Position = vertex_position;
+}
+)";
+
+const char * GLES1_SharedResources::pixels_fragment_shader = R"(
+uniform highp sampler2D pixels;
+// the window coordinates of the lower left corner of the pixels
+uniform highp vec2 origin;
+
+out highp vec4 FragColor;
+
+void main() {
+    FragColor = texelFetch(pixels, ivec2(gl_FragCoord.xy - origin), 0);
+}
+)";
+
+// the driver does not report the memory a program takes, its binary is the closest estimate
+// called with the context that linked shader current
+static qint64 programSize(QOpenGLShaderProgram * shader)
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    bool binaries = context->isOpenGLES()
+            ? context->format().majorVersion() >= 3
+            : context->format().version() >= qMakePair(4, 1) || context->hasExtension(QByteArrayLiteral("GL_ARB_get_program_binary"));
+    if (!binaries) return 0;
+    GLint length = 0;
+    context->extraFunctions()->glGetProgramiv(shader->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    return length;
+}
+
+// called with the context that linked shader current
+static GLES1_Program describeProgram(QOpenGLShaderProgram * shader)
+{
+    GLES1_Program program;
+    program.shader = shader;
+    program.size = programSize(shader);
+    program.projectionUniform = shader->uniformLocation("projection");
+    program.modelViewUniform = shader->uniformLocation("modelView");
+    program.normalUniform = shader->uniformLocation("normal");
+    program.pixelsUniform = shader->uniformLocation("pixels");
+    program.originUniform = shader->uniformLocation("origin");
+    return program;
+}
+
+static QMutex registryMutex;
+static QWaitCondition warmUpFinished;
+static QHash<QOpenGLContextGroup*, GLES1_SharedResources*> registry;
+
+class GLES1_WarmUpThread : public QThread
+{
+    // kept alive until the warm up is done, contextAboutToBeDestroyed waits for it
+    QOpenGLContext * shareContext;
+    QSurfaceFormat format;
+    QThread * targetThread;
+    QOffscreenSurface * surface;
+    GLES1_SharedResources * resources;
+
+public:
+    GLES1_WarmUpThread(QOpenGLContext * shareContext, QOffscreenSurface * surface, GLES1_SharedResources * resources)
+        : shareContext(shareContext), format(shareContext->format()), targetThread(shareContext->thread()),
+          surface(surface), resources(resources) {}
+
+protected:
+    void run() override {
+        // described while the worker context is current, only the results are handed over
+        GLES1_Program linked[GLES1_SharedResources::VariantCount];
+        {
+            QOpenGLContext context;
+            context.setFormat(format);
+            context.setShareContext(shareContext);
+            if (context.create() && context.makeCurrent(surface)) {
+                for (int variant = 0; variant < GLES1_SharedResources::VariantCount; variant++) {
+                    QOpenGLShaderProgram * shader = GLES1_SharedResources::compileProgram(&context, GLES1_SharedResources::Variant(variant));
+                    if (shader == nullptr) continue;
+                    linked[variant] = describeProgram(shader);
+                    // programs are used from the thread the wrappers live in
+                    shader->moveToThread(targetThread);
+                }
+                context.doneCurrent();
+            } else {
+                qWarning("GLES1_Wrapper: could not create a shared context to warm up shaders on");
+            }
+        }
+
+        QMutexLocker lock(&registryMutex);
+        resources->warmingUp = false;
+        for (int variant = 0; variant < GLES1_SharedResources::VariantCount; variant++) {
+            if (linked[variant].shader == nullptr) continue;
+            if (resources->programs[variant].shader == nullptr && resources->registered) {
+                resources->setProgram(GLES1_SharedResources::Variant(variant), linked[variant]);
+            } else {
+                delete linked[variant].shader;
+            }
+        }
+        if (!resources->registered && resources->references == 0) {
+            delete resources;
+        }
+        warmUpFinished.wakeAll();
+    }
+};
+
+GLES1_SharedResources::GLES1_SharedResources(QOpenGLContextGroup * group) : group(group), quadIndexCapacity(0) {
+}
+
+GLES1_SharedResources * GLES1_SharedResources::acquire(QOpenGLContext * context)
+{
+    QMutexLocker lock(&registryMutex);
+    GLES1_SharedResources * resources = registry.value(context->shareGroup());
+    if (resources == nullptr) {
+        resources = new GLES1_SharedResources(context->shareGroup());
+        registry[context->shareGroup()] = resources;
+    }
+    resources->watch(context);
+    resources->waitForWarmUp();
+    if (resources->programs[DefaultVariant].shader == nullptr) {
+        resources->setProgram(DefaultVariant, describeProgram(compileProgram(context, DefaultVariant)));
+    }
+    if (resources->quadIndices == 0) {
+        resources->growQuadIndices(context->functions(), initialQuadCapacity);
+    }
+    resources->references++;
+    return resources;
+}
+
+void GLES1_SharedResources::waitForWarmUp()
+{
+    while (warmingUp) {
+        // finishing the compile already in flight is never slower than starting another one
+        warmUpFinished.wait(&registryMutex);
+    }
+}
+
+const GLES1_Program * GLES1_SharedResources::program(QOpenGLContext *context, Variant variant)
+{
+    QMutexLocker lock(&registryMutex);
+    waitForWarmUp();
+    if (programs[variant].shader == nullptr && !programFailed[variant]) {
+        QOpenGLShaderProgram * shader = compileProgram(context, variant);
+        if (shader == nullptr) {
+            programFailed[variant] = true;
+        } else {
+            setProgram(variant, describeProgram(shader));
+        }
+    }
+    return programs[variant].shader != nullptr ? &programs[variant] : nullptr;
+}
+
+void GLES1_SharedResources::release()
+{
+    QMutexLocker lock(&registryMutex);
+    if (--references > 0) return;
+
+    if (!registered) {
+        // the share group is gone, the GL objects went with it
+        delete this;
+        return;
+    }
+
+    QOpenGLContext * current = QOpenGLContext::currentContext();
+    if (!warmingUp && current != nullptr && current->shareGroup() == group) {
+        destroy(current);
+        registry.remove(group);
+        delete this;
+    }
+}
+
+void GLES1_SharedResources::watch(QOpenGLContext *context)
+{
+    if (watchedContexts.contains(context)) return;
+    watchedContexts.append(context);
+    QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [context]() {
+        contextAboutToBeDestroyed(context);
+    });
+}
+
+void GLES1_SharedResources::contextAboutToBeDestroyed(QOpenGLContext *context)
+{
+    QMutexLocker lock(&registryMutex);
+    GLES1_SharedResources * resources = registry.value(context->shareGroup());
+    if (resources == nullptr) return;
+    // the warm up thread shares with context
+    resources->waitForWarmUp();
+    resources->watchedContexts.removeAll(context);
+
+    // objects survive in the group as long as any other context shares them
+    if (context->shareGroup()->shares().length() > 1) return;
+
+    // context is current while aboutToBeDestroyed is emitted
+    resources->destroy(context);
+    registry.remove(resources->group);
+    resources->registered = false;
+    if (resources->references == 0 && !resources->warmingUp) {
+        delete resources;
+    }
+}
+
+void GLES1_SharedResources::warmUp(QOpenGLContext *shareContext)
+{
+    QMutexLocker lock(&registryMutex);
+    GLES1_SharedResources * resources = registry.value(shareContext->shareGroup());
+    if (resources == nullptr) {
+        resources = new GLES1_SharedResources(shareContext->shareGroup());
+        registry[shareContext->shareGroup()] = resources;
+    }
+    if (resources->programs[DefaultVariant].shader != nullptr || resources->warmingUp) return;
+    resources->watch(shareContext);
+    resources->warmingUp = true;
+
+    // offscreen surfaces must be created and destroyed on the gui thread
+    QOffscreenSurface * surface = new QOffscreenSurface;
+    surface->setFormat(shareContext->format());
+    surface->create();
+
+    GLES1_WarmUpThread * thread = new GLES1_WarmUpThread(shareContext, surface, resources);
+    QObject::connect(thread, &QThread::finished, surface, &QObject::deleteLater);
+    QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
+}
+
+void GLES1_SharedResources::destroy(QOpenGLContext *context)
+{
+    QOpenGLFunctions * gles2 = context->functions();
+    for (GLES1_Program & program : programs) {
+        if (program.shader != nullptr) {
+            GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Programs, program.size, 1);
+        }
+        delete program.shader;
+        program = GLES1_Program();
+    }
+    if (quadIndices != 0) {
+        GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Buffers, quadIndexBytes(), 1);
+        gles2->glDeleteBuffers(1, &quadIndices);
+        quadIndices = 0;
+        quadIndexCapacity.storeRelease(0);
+    }
+    for (const GLES1_StreamBuffer & stream : streamBuffers) {
+        GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Buffers, stream.capacity, 1);
+        gles2->glDeleteBuffers(1, &stream.buffer);
+    }
+    streamBuffers.clear();
+}
+
+QOpenGLShaderProgram * GLES1_SharedResources::compileProgram(QOpenGLContext *context, Variant variant)
+{
+    QOpenGLShaderProgram * program = new QOpenGLShaderProgram;
+
+    QByteArray v = variant == PixelsVariant ? pixels_vertex_shader : vertex_shader;
+    QByteArray f = variant == PixelsVariant ? pixels_fragment_shader : fragment_shader;
+
+    if (variant == MatrixArrayVariant) {
+        v.prepend("#define MATRIX_ARRAY\n#define MODELVIEW_ARRAY_SIZE " + QByteArray::number(modelViewArraySize) + "\n");
+    }
+
+    // Any number representing a version of the language a compiler does not support
+    // will cause an error to be generated.
+
+    if (context->isOpenGLES()) {
+        // android supports OpenGL ES 3.0 since android 4.3 (kitkat)
+
+        // android supports OpenGL ES 3.1 since android 5.0 (lollipop)
+        //  New functionality in OpenGL ES 3.1 includes:
+        //   Compute shaders
+        //   Independent vertex and fragment shaders
+        //   Indirect draw commands
+
+        // android supports OpenGL ES 3.2 since android 6.0 (marshmellow), possibly 7.0 (naugat)
+
+        // OpenGL ES 3.0 (#version 300 es)
+        // OpenGL ES 3.1 (#version 310 es)
+        // OpenGL ES 3.2 (#version 320 es)
+
+        v.prepend(QByteArrayLiteral("#version 300 es\n"));
+        f.prepend(QByteArrayLiteral("#version 300 es\n"));
+    } else {
+        // OpenGL 3.3 (GLSL #version 330)
+        v.prepend(QByteArrayLiteral("#version 330\n"));
+        f.prepend(QByteArrayLiteral("#version 330\n"));
+    }
+    bool built = program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, v)
+            && program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, f)
+            && program->link();
+
+    if (variant == DefaultVariant) {
+        if (!built) {
+            qFatal("OPENGL SHADER COMPILATION OR LINK FAILED");
+        }
+        return program;
+    }
+
+    if (!built) {
+        // optional variants only disable the feature using them
+        qWarning() << "GLES1_Wrapper: shader variant" << variant << "is not supported:" << program->log();
+        delete program;
+        return nullptr;
+    }
+    if (variant == MatrixArrayVariant) {
+        QOpenGLExtraFunctions * gles3 = context->extraFunctions();
+        GLuint block = gles3->glGetUniformBlockIndex(program->programId(), "ModelViews");
+        gles3->glUniformBlockBinding(program->programId(), block, modelViewArrayBinding);
+    }
+    return program;
+}
+
+void GLES1_SharedResources::setProgram(Variant variant, const GLES1_Program &program)
+{
+    programs[variant] = program;
+    GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Programs, program.size, 1);
+}
+
+void GLES1_SharedResources::growQuadIndices(QOpenGLFunctions *gles2, int quadCount)
+{
+    int capacity = qMax(quadCount, quadIndexCapacity.loadAcquire() * 2);
+    QList<GLuint> elements;
+    elements.reserve(capacity * 6);
+    for (GLuint p = 0; p < static_cast<GLuint>(capacity) * 4; p += 4) {
+        elements.append({
+            p, p + 1, p + 2,
+            p, p + 2, p + 3
+        });
+    }
+
+    if (quadIndices == 0) {
+        gles2->glGenBuffers(1, &quadIndices);
+        GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Buffers, 0, 1);
+    }
+    GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Buffers, quadIndexBytes(), elements.length() * sizeof(GLuint));
+    GLint previous;
+    gles2->glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &previous);
+    gles2->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndices);
+    gles2->glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.length() * sizeof(GLuint), elements.data(), GL_STATIC_DRAW);
+    gles2->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, previous);
+    quadIndexCapacity.storeRelease(capacity);
+}
+
+qint64 GLES1_SharedResources::quadIndexBytes() const
+{
+    return static_cast<qint64>(quadIndexCapacity.loadAcquire()) * 6 * sizeof(GLuint);
+}
+
+GLuint GLES1_SharedResources::quadIndexBuffer(QOpenGLFunctions *gles2, int quadCount)
+{
+    if (quadCount > quadIndexCapacity.loadAcquire()) {
+        QMutexLocker lock(&registryMutex);
+        if (quadCount > quadIndexCapacity.loadAcquire()) {
+            growQuadIndices(gles2, quadCount);
+        }
+    }
+    return quadIndices;
+}
+
+GLES1_StreamBuffer GLES1_SharedResources::takeStreamBuffer(QOpenGLFunctions *gles2)
+{
+    QMutexLocker lock(&registryMutex);
+    if (!streamBuffers.isEmpty()) {
+        return streamBuffers.takeLast();
+    }
+    GLES1_StreamBuffer stream;
+    gles2->glGenBuffers(1, &stream.buffer);
+    GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Buffers, 0, 1);
+    return stream;
+}
+
+void GLES1_SharedResources::returnStreamBuffer(const GLES1_StreamBuffer &buffer)
+{
+    QMutexLocker lock(&registryMutex);
+    if (!registered) {
+        // the share group is gone, the buffer went with it
+        GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Buffers, buffer.capacity, 1);
+        return;
+    }
+    streamBuffers.append(buffer);
+}
@@ -0,0 +1,113 @@
+#ifndef GLES1_SHAREDRESOURCES_H
+#define GLES1_SHAREDRESOURCES_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+
+// a buffer that vertex or index data is appended to, its storage is orphaned once full
+struct GLES1_StreamBuffer
+{
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+    GLsizeiptr offset = 0;
+};
+
+// a linked program and the locations the wrapper feeds
+struct GLES1_Program
+{
+    QOpenGLShaderProgram * shader = nullptr;
+    int projectionUniform = -1;
+    int modelViewUniform = -1;
+    int normalUniform = -1;
+    int pixelsUniform = -1;
+    int originUniform = -1;
+    // the program binary size, as accounted in GLES1_MemoryAccounting
+    qint64 size = 0;
+};
+
+// GL objects shared by every GLES1_Wrapper whose context belongs to the same share group,
+// deleted with the last reference or, if no context of the group is current then, with the last context
+//
+// program binaries are cached on disk by Qt per driver and shader source
+
+class GLES1_SharedResources
+{
+public:
+
+    enum Variant {
+        DefaultVariant,
+        // the modelview matrix is picked per vertex from a uniform buffer bound at modelViewArrayBinding
+        MatrixArrayVariant,
+        // draws a texture of pixels, positions in normalized device coordinates
+        PixelsVariant,
+        VariantCount
+    };
+
+private:
+
+    static const char * vertex_shader;
+    static const char * fragment_shader;
+    static const char * pixels_vertex_shader;
+    static const char * pixels_fragment_shader;
+
+    friend class GLES1_WarmUpThread;
+
+    QOpenGLContextGroup * group;
+    int references = 0;
+    bool registered = true;
+    bool warmingUp = false;
+    QList<QOpenGLContext*> watchedContexts;
+
+    GLES1_Program programs[VariantCount];
+    bool programFailed[VariantCount] = {};
+
+    GLuint quadIndices = 0;
+    QAtomicInt quadIndexCapacity;
+    QList<GLES1_StreamBuffer> streamBuffers;
+
+    GLES1_SharedResources(QOpenGLContextGroup * group);
+
+    void watch(QOpenGLContext * context);
+    void destroy(QOpenGLContext * context);
+    static void contextAboutToBeDestroyed(QOpenGLContext * context);
+
+    static QOpenGLShaderProgram * compileProgram(QOpenGLContext * context, Variant variant);
+    void setProgram(Variant variant, const GLES1_Program & program);
+    void waitForWarmUp();
+    qint64 quadIndexBytes() const;
+    void growQuadIndices(QOpenGLFunctions * gles2, int quadCount);
+
+public:
+
+    // quads covered by the static quad index buffer when it is first created
+    static const int initialQuadCapacity = 16384;
+
+    // a std140 array of mat4, 16 KiB is the smallest GL_MAX_UNIFORM_BLOCK_SIZE an implementation may have
+    static const int modelViewArraySize = 256;
+    static const GLuint modelViewArrayBinding = 0;
+
+    // returns the resources of the share group of context, creating them on first use
+    // context must be current
+    static GLES1_SharedResources * acquire(QOpenGLContext * context);
+    void release();
+
+    // compiles the variant on first use, returns nullptr if the implementation cannot build it
+    // context must be current and in the share group
+    const GLES1_Program * program(QOpenGLContext * context, Variant variant);
+
+    // compiles every program variant of the group on a worker thread, call it from the thread of shareContext,
+    // new wrappers and destroyed contexts of the group wait for it
+    static void warmUp(QOpenGLContext * shareContext);
+
+    // a GL_ELEMENT_ARRAY_BUFFER of GLuint holding 0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7, ...
+    // large enough to draw at least quadCount quads as GL_TRIANGLES
+    GLuint quadIndexBuffer(QOpenGLFunctions * gles2, int quadCount);
+
+    GLES1_StreamBuffer takeStreamBuffer(QOpenGLFunctions * gles2);
+    void returnStreamBuffer(const GLES1_StreamBuffer & buffer);
+};
+
+#endif // GLES1_SHAREDRESOURCES_H
@@ -0,0 +1,677 @@
+#include "GLES1_Shim.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#define GLES1_SHIM_EXPORT extern "C" Q_DECL_EXPORT
+
+// the binding of the calling thread, valid while generation matches the global one
+struct GLES1_ShimCache
+{
+    QOpenGLContext * context = nullptr;
+    GLES1_Wrapper * wrapper = nullptr;
+    int generation = 0;
+    bool inBlock = false;
+    // set while a state setter is forwarded
+    bool forwarding = false;
+};
+
+static QMutex shimMutex;
+static QHash<QOpenGLContext*, GLES1_Wrapper*> wrappers;
+// bumped whenever a binding changes, which invalidates the cache of every thread
+static QAtomicInt generation(1);
+static thread_local GLES1_ShimCache cache;
+
+void GLES1_Shim::attach(QOpenGLContext *context, GLES1_Wrapper *wrapper)
+{
+    QMutexLocker lock(&shimMutex);
+    if (!wrappers.contains(context)) {
+        QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [context]() {
+            detach(context);
+        });
+    }
+    wrappers[context] = wrapper;
+    generation.fetchAndAddOrdered(1);
+}
+
+void GLES1_Shim::detach(QOpenGLContext *context)
+{
+    QMutexLocker lock(&shimMutex);
+    if (wrappers.remove(context) > 0) {
+        generation.fetchAndAddOrdered(1);
+    }
+}
+
+static GLES1_Wrapper * resolve(QOpenGLContext * context)
+{
+    QMutexLocker lock(&shimMutex);
+    cache.context = context;
+    cache.wrapper = wrappers.value(context);
+    cache.generation = generation.loadAcquire();
+    return cache.wrapper;
+}
+
+// the wrapper of the current context
+static inline GLES1_Wrapper * bound()
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (Q_LIKELY(cache.context == context && cache.generation == generation.loadAcquire())) return cache.wrapper;
+    return resolve(context);
+}
+
+// between glBegin and glEnd the current context cannot change, so vertex attributes skip looking it up
+static inline GLES1_Wrapper * vertexTarget()
+{
+    if (Q_LIKELY(cache.inBlock && cache.generation == generation.loadAcquire())) return cache.wrapper;
+    return bound();
+}
+
+// a core state setter goes to the bound wrapper so that its shadow stays current, and to the driver through
+// the functions Qt resolved for the context when none is bound, a call reaching the shim again while one is
+// forwarded means the driver entry point resolved to the shim itself and is dropped
+template <typename ToWrapper, typename ToDriver>
+static inline void forwardState(const char * name, ToWrapper toWrapper, ToDriver toDriver)
+{
+    if (Q_UNLIKELY(cache.forwarding)) {
+        qWarning() << "GLES1_Shim:" << name << "resolved back to the shim, the call is dropped";
+        return;
+    }
+    cache.forwarding = true;
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) {
+        toWrapper(wrapper);
+    } else if (QOpenGLContext * context = QOpenGLContext::currentContext()) {
+        toDriver(context->functions());
+    }
+    cache.forwarding = false;
+}
+
+GLES1_SHIM_EXPORT void APIENTRY glBegin(GLenum mode)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper == nullptr) return;
+    wrapper->glBegin(mode);
+    cache.inBlock = true;
+}
+GLES1_SHIM_EXPORT void APIENTRY glEnd()
+{
+    cache.inBlock = false;
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glEnd();
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos2i(GLint x, GLint y)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos2i(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos2f(GLfloat x, GLfloat y)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos2f(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos2d(GLdouble x, GLdouble y)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos2d(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos3f(GLfloat x, GLfloat y, GLfloat z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos3f(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos3d(GLdouble x, GLdouble y, GLdouble z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos3d(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos4f(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRasterPos4d(GLdouble x, GLdouble y, GLdouble z, GLdouble w)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRasterPos4d(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, const void * data)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glDrawPixels(width, height, format, type, data);
+}
+GLES1_SHIM_EXPORT GLint APIENTRY glRenderMode(GLenum mode)
+{
+    GLES1_Wrapper * wrapper = bound();
+    return wrapper != nullptr ? wrapper->glRenderMode(mode) : 0;
+}
+GLES1_SHIM_EXPORT void APIENTRY glSelectBuffer(GLsizei size, GLuint * buffer)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glSelectBuffer(size, buffer);
+}
+GLES1_SHIM_EXPORT void APIENTRY glInitNames()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glInitNames();
+}
+GLES1_SHIM_EXPORT void APIENTRY glPushName(GLuint name)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPushName(name);
+}
+GLES1_SHIM_EXPORT void APIENTRY glPopName()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPopName();
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadName(GLuint name)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadName(name);
+}
+GLES1_SHIM_EXPORT void APIENTRY glPushAttrib(GLbitfield mask)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPushAttrib(mask);
+}
+GLES1_SHIM_EXPORT void APIENTRY glPopAttrib()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPopAttrib();
+}
+GLES1_SHIM_EXPORT void APIENTRY glEnable(GLenum capability)
+{
+    forwardState("glEnable", [=](GLES1_Wrapper * wrapper) { wrapper->glEnable(capability); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glEnable(capability); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glDisable(GLenum capability)
+{
+    forwardState("glDisable", [=](GLES1_Wrapper * wrapper) { wrapper->glDisable(capability); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glDisable(capability); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glBlendFunc(GLenum source, GLenum destination)
+{
+    forwardState("glBlendFunc", [=](GLES1_Wrapper * wrapper) { wrapper->glBlendFunc(source, destination); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glBlendFunc(source, destination); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glBlendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+    forwardState("glBlendFuncSeparate",
+                 [=](GLES1_Wrapper * wrapper) { wrapper->glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glBlendEquation(GLenum mode)
+{
+    forwardState("glBlendEquation", [=](GLES1_Wrapper * wrapper) { wrapper->glBlendEquation(mode); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glBlendEquation(mode); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+{
+    forwardState("glBlendEquationSeparate", [=](GLES1_Wrapper * wrapper) { wrapper->glBlendEquationSeparate(modeRGB, modeAlpha); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glBlendEquationSeparate(modeRGB, modeAlpha); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    forwardState("glColorMask", [=](GLES1_Wrapper * wrapper) { wrapper->glColorMask(red, green, blue, alpha); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glColorMask(red, green, blue, alpha); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    forwardState("glClearColor", [=](GLES1_Wrapper * wrapper) { wrapper->glClearColor(red, green, blue, alpha); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glClearColor(red, green, blue, alpha); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glDepthFunc(GLenum func)
+{
+    forwardState("glDepthFunc", [=](GLES1_Wrapper * wrapper) { wrapper->glDepthFunc(func); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glDepthFunc(func); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glDepthMask(GLboolean flag)
+{
+    forwardState("glDepthMask", [=](GLES1_Wrapper * wrapper) { wrapper->glDepthMask(flag); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glDepthMask(flag); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glClearDepth(GLdouble depth)
+{
+    forwardState("glClearDepth", [=](GLES1_Wrapper * wrapper) { wrapper->glClearDepth(depth); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glClearDepthf(GLfloat(depth)); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glDepthRange(GLdouble nearVal, GLdouble farVal)
+{
+    forwardState("glDepthRange", [=](GLES1_Wrapper * wrapper) { wrapper->glDepthRange(nearVal, farVal); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glDepthRangef(GLfloat(nearVal), GLfloat(farVal)); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    forwardState("glViewport", [=](GLES1_Wrapper * wrapper) { wrapper->glViewport(x, y, width, height); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glViewport(x, y, width, height); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    forwardState("glScissor", [=](GLES1_Wrapper * wrapper) { wrapper->glScissor(x, y, width, height); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glScissor(x, y, width, height); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glActiveTexture(GLenum unit)
+{
+    forwardState("glActiveTexture", [=](GLES1_Wrapper * wrapper) { wrapper->glActiveTexture(unit); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glActiveTexture(unit); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glBindTexture(GLenum target, GLuint texture)
+{
+    forwardState("glBindTexture", [=](GLES1_Wrapper * wrapper) { wrapper->glBindTexture(target, texture); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glBindTexture(target, texture); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glDeleteTextures(GLsizei count, const GLuint * textures)
+{
+    forwardState("glDeleteTextures", [=](GLES1_Wrapper * wrapper) { wrapper->glDeleteTextures(count, textures); },
+                 [=](QOpenGLFunctions * gles2) { gles2->glDeleteTextures(count, textures); });
+}
+GLES1_SHIM_EXPORT void APIENTRY glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble nearVal, GLdouble farVal)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glOrtho(left, right, bottom, top, nearVal, farVal);
+}
+GLES1_SHIM_EXPORT void APIENTRY glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble nearVal, GLdouble farVal)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glFrustum(left, right, bottom, top, nearVal, farVal);
+}
+GLES1_SHIM_EXPORT void APIENTRY glMatrixMode(GLenum mode)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glMatrixMode(mode);
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadIdentity()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadIdentity();
+}
+GLES1_SHIM_EXPORT void APIENTRY glPushMatrix()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPushMatrix();
+}
+GLES1_SHIM_EXPORT void APIENTRY glPopMatrix()
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glPopMatrix();
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadMatrixd(const GLdouble * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadMatrixd(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadMatrixf(const GLfloat * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadMatrixf(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glMultMatrixd(const GLdouble * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glMultMatrixd(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glMultMatrixf(const GLfloat * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glMultMatrixf(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadTransposeMatrixd(const GLdouble * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadTransposeMatrixd(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glLoadTransposeMatrixf(const GLfloat * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glLoadTransposeMatrixf(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glMultTransposeMatrixd(const GLdouble * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glMultTransposeMatrixd(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glMultTransposeMatrixf(const GLfloat * m)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glMultTransposeMatrixf(m);
+}
+GLES1_SHIM_EXPORT void APIENTRY glTranslated(GLdouble x, GLdouble y, GLdouble z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glTranslated(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glTranslatef(GLfloat x, GLfloat y, GLfloat z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glTranslatef(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glScaled(GLdouble x, GLdouble y, GLdouble z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glScaled(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glScalef(GLfloat x, GLfloat y, GLfloat z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glScalef(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRotated(GLdouble angle, GLdouble x, GLdouble y, GLdouble z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRotated(angle, x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+{
+    GLES1_Wrapper * wrapper = bound();
+    if (wrapper != nullptr) wrapper->glRotatef(angle, x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glNormal3b(GLbyte nx, GLbyte ny, GLbyte nz)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glNormal3b(nx, ny, nz);
+}
+GLES1_SHIM_EXPORT void APIENTRY glNormal3d(GLdouble nx, GLdouble ny, GLdouble nz)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glNormal3d(nx, ny, nz);
+}
+GLES1_SHIM_EXPORT void APIENTRY glNormal3f(GLfloat nx, GLfloat ny, GLfloat nz)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glNormal3f(nx, ny, nz);
+}
+GLES1_SHIM_EXPORT void APIENTRY glNormal3i(GLint nx, GLint ny, GLint nz)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glNormal3i(nx, ny, nz);
+}
+GLES1_SHIM_EXPORT void APIENTRY glNormal3s(GLshort nx, GLshort ny, GLshort nz)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glNormal3s(nx, ny, nz);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2s(GLshort x, GLshort y)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2s(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2i(GLint x, GLint y)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2i(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2f(GLfloat x, GLfloat y)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2f(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2d(GLdouble x, GLdouble y)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2d(x, y);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3s(GLshort x, GLshort y, GLshort z)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3s(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3i(GLint x, GLint y, GLint z)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3i(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3f(GLfloat x, GLfloat y, GLfloat z)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3f(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3d(GLdouble x, GLdouble y, GLdouble z)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3d(x, y, z);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4s(GLshort x, GLshort y, GLshort z, GLshort w)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4s(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4i(GLint x, GLint y, GLint z, GLint w)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4i(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4f(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4d(GLdouble x, GLdouble y, GLdouble z, GLdouble w)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4d(x, y, z, w);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2sv(const GLshort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2sv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2iv(const GLint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2iv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2fv(const GLfloat * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2fv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex2dv(const GLdouble * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex2dv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3sv(const GLshort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3sv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3iv(const GLint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3iv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3fv(const GLfloat * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3fv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex3dv(const GLdouble * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex3dv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4sv(const GLshort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4sv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4iv(const GLint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4iv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4fv(const GLfloat * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4fv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glVertex4dv(const GLdouble * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glVertex4dv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3b(GLbyte red, GLbyte green, GLbyte blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3b(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3s(GLshort red, GLshort green, GLshort blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3s(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3i(GLint red, GLint green, GLint blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3i(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3f(GLfloat red, GLfloat green, GLfloat blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3f(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3d(GLdouble red, GLdouble green, GLdouble blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3d(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3ub(GLubyte red, GLubyte green, GLubyte blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3ub(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3us(GLushort red, GLushort green, GLushort blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3us(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3ui(GLuint red, GLuint green, GLuint blue)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3ui(red, green, blue);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4b(GLbyte red, GLbyte green, GLbyte blue, GLbyte alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4b(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4s(GLshort red, GLshort green, GLshort blue, GLshort alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4s(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4i(GLint red, GLint green, GLint blue, GLint alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4i(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4f(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4d(GLdouble red, GLdouble green, GLdouble blue, GLdouble alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4d(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4ub(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4ub(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4us(GLushort red, GLushort green, GLushort blue, GLushort alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4us(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4ui(GLuint red, GLuint green, GLuint blue, GLuint alpha)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4ui(red, green, blue, alpha);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3bv(const GLbyte * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3bv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3sv(const GLshort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3sv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3iv(const GLint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3iv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3fv(const GLfloat * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3fv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3dv(const GLdouble * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3dv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3ubv(const GLubyte * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3ubv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3usv(const GLushort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3usv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor3uiv(const GLuint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor3uiv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4bv(const GLbyte * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4bv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4sv(const GLshort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4sv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4iv(const GLint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4iv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4fv(const GLfloat * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4fv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4dv(const GLdouble * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4dv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4ubv(const GLubyte * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4ubv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4usv(const GLushort * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4usv(v);
+}
+GLES1_SHIM_EXPORT void APIENTRY glColor4uiv(const GLuint * v)
+{
+    GLES1_Wrapper * wrapper = vertexTarget();
+    if (wrapper != nullptr) wrapper->glColor4uiv(v);
+}
@@ -0,0 +1,23 @@
+#ifndef GLES1_SHIM_H
+#define GLES1_SHIM_H
+
+#include "GLES1_Wrapper.h"
+
+// exports the GL 1.x entry points of GLES1_Wrapper as C functions, forwarded to the wrapper attached to
+// the current context, calls without one are dropped
+//
+// the core state setters the attribute stack shadows are exported too, they go to the driver through Qt
+// when no wrapper is attached, other core entry points such as glClear stay with the driver
+//
+// each thread caches the wrapper it resolved last, locking only when that is stale
+
+class GLES1_Shim
+{
+public:
+
+    // detach before destroying wrapper, contexts are detached when they are destroyed
+    static void attach(QOpenGLContext * context, GLES1_Wrapper * wrapper);
+    static void detach(QOpenGLContext * context);
+};
+
+#endif // GLES1_SHIM_H
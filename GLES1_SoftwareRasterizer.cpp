@@ -0,0 +1,769 @@
+#include "GLES1_SoftwareRasterizer.h"
+#include "GLES1_MemoryAccounting.h"
+
+#include <QDebug>
+#include <QThread>
+#include <QVector4D>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GLES1_RASTERIZER_SSE2
+#endif
+
+// positions are snapped to this fraction of a pixel so shared edges see the same coordinates
+static const float subpixel = 256;
+
+static inline float snap(float value)
+{
+    return std::floor(value * subpixel + 0.5f) / subpixel;
+}
+
+// triangles and lines are clipped this many pixels outside the viewport, which keeps the snapped
+// coordinates and the edge functions within float precision
+static const float guardBand = 4096;
+static const int planeCount = 6;
+
+// the signed distances to the near and far planes and the guard band, inside when not negative,
+// guard holds the x and y extent of the guard band in normalized device coordinates
+static inline float planeDistance(const float * position, int plane, const float * guard)
+{
+    switch (plane) {
+    case 0: return position[3] + position[2];
+    case 1: return position[3] - position[2];
+    case 2: return guard[0] * position[3] + position[0];
+    case 3: return guard[0] * position[3] - position[0];
+    case 4: return guard[1] * position[3] + position[1];
+    default: return guard[1] * position[3] - position[1];
+    }
+}
+
+static inline bool depthPasses(float z, float stored, GLenum func)
+{
+    switch (func) {
+    case GL_NEVER: return false;
+    case GL_LESS: return z < stored;
+    case GL_EQUAL: return z == stored;
+    case GL_LEQUAL: return z <= stored;
+    case GL_GREATER: return z > stored;
+    case GL_NOTEQUAL: return z != stored;
+    case GL_GEQUAL: return z >= stored;
+    default: return true;
+    }
+}
+
+#ifdef GLES1_RASTERIZER_SSE2
+static inline __m128 depthPasses(__m128 z, __m128 stored, GLenum func)
+{
+    switch (func) {
+    case GL_NEVER: return _mm_setzero_ps();
+    case GL_LESS: return _mm_cmplt_ps(z, stored);
+    case GL_EQUAL: return _mm_cmpeq_ps(z, stored);
+    case GL_LEQUAL: return _mm_cmple_ps(z, stored);
+    case GL_GREATER: return _mm_cmpgt_ps(z, stored);
+    case GL_NOTEQUAL: return _mm_cmpneq_ps(z, stored);
+    case GL_GEQUAL: return _mm_cmpge_ps(z, stored);
+    default: return _mm_castsi128_ps(_mm_set1_epi32(-1));
+    }
+}
+
+// a lane of all ones for every set bit of mask
+static inline __m128 laneMask(int mask)
+{
+    const __m128i bits = _mm_set_epi32(8, 4, 2, 1);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits));
+}
+#endif
+
+static float blendFactor(GLenum factor, const float * source, const float * destination, int component)
+{
+    switch (factor) {
+    case GL_ZERO: return 0;
+    case GL_ONE: return 1;
+    case GL_SRC_COLOR: return source[component];
+    case GL_ONE_MINUS_SRC_COLOR: return 1 - source[component];
+    case GL_DST_COLOR: return destination[component];
+    case GL_ONE_MINUS_DST_COLOR: return 1 - destination[component];
+    case GL_SRC_ALPHA: return source[3];
+    case GL_ONE_MINUS_SRC_ALPHA: return 1 - source[3];
+    case GL_DST_ALPHA: return destination[3];
+    case GL_ONE_MINUS_DST_ALPHA: return 1 - destination[3];
+    case GL_SRC_ALPHA_SATURATE: return component == 3 ? 1 : qMin(source[3], 1 - destination[3]);
+    // there is no glBlendColor
+    default: return 1;
+    }
+}
+
+static float blendEquation(GLenum mode, float source, float sourceFactor, float destination, float destinationFactor)
+{
+    switch (mode) {
+    case GL_FUNC_SUBTRACT: return source * sourceFactor - destination * destinationFactor;
+    case GL_FUNC_REVERSE_SUBTRACT: return destination * destinationFactor - source * sourceFactor;
+    case GL_MIN: return qMin(source, destination);
+    case GL_MAX: return qMax(source, destination);
+    default: return source * sourceFactor + destination * destinationFactor;
+    }
+}
+
+GLES1_SoftwareRasterizer::GLES1_SoftwareRasterizer(int width, int height)
+    : width(0), height(0), stride(0), tilesX(0), tilesY(0)
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+    GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Framebuffers, 0, 1);
+    resize(width, height);
+}
+
+GLES1_SoftwareRasterizer::~GLES1_SoftwareRasterizer()
+{
+    pool.waitForDone();
+    GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Framebuffers, qint64(stride) * height * (4 + sizeof(GLfloat)), 1);
+}
+
+void GLES1_SoftwareRasterizer::resize(int width, int height)
+{
+    finish();
+    qint64 oldBytes = qint64(stride) * this->height * (4 + sizeof(GLfloat));
+
+    this->width = qMax(0, width);
+    this->height = qMax(0, height);
+    stride = (this->width + 3) & ~3;
+    colors.fill(0, stride * this->height * 4);
+    depths.fill(1, stride * this->height);
+
+    GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Framebuffers, oldBytes, qint64(stride) * this->height * (4 + sizeof(GLfloat)));
+
+    tilesX = (this->width + tileSize - 1) / tileSize;
+    tilesY = (this->height + tileSize - 1) / tileSize;
+    bins.clear();
+    bins.resize(tilesX * tilesY);
+
+    setViewport(0, 0, this->width, this->height);
+    scissor(0, 0, this->width, this->height);
+}
+
+int GLES1_SoftwareRasterizer::getWidth() const
+{
+    return width;
+}
+
+int GLES1_SoftwareRasterizer::getHeight() const
+{
+    return height;
+}
+
+void GLES1_SoftwareRasterizer::draw(GLenum mode, const GLES1_Vertex *vertices, int vertexCount, const QMatrix4x4 &projection, const QMatrix4x4 &modelView)
+{
+    if (vertexCount == 0 || width == 0 || height == 0) return;
+
+    if (stateChanged) {
+        states.append(current);
+        stateChanged = false;
+    }
+
+    const QMatrix4x4 transform = projection * modelView;
+    clipVertices.resize(vertexCount);
+    ClipVertex * clip = clipVertices.data();
+    for (int i = 0; i < vertexCount; i++) {
+        const GLES1_Vertex & vertex = vertices[i];
+        const QVector4D position = transform * QVector4D(vertex.x, vertex.y, vertex.z, vertex.w);
+        clip[i].position[0] = position.x();
+        clip[i].position[1] = position.y();
+        clip[i].position[2] = position.z();
+        clip[i].position[3] = position.w();
+        clip[i].color[0] = vertex.red;
+        clip[i].color[1] = vertex.green;
+        clip[i].color[2] = vertex.blue;
+        clip[i].color[3] = vertex.alpha;
+    }
+
+    const ClipVertex * v = clip;
+    switch (mode) {
+    case GL_POINTS:
+        for (int i = 0; i < vertexCount; i++) {
+            addPoint(v[i]);
+        }
+        break;
+    case GL_LINES:
+        for (int i = 0; i + 1 < vertexCount; i += 2) {
+            addLine(v[i], v[i + 1]);
+        }
+        break;
+    case GL_LINE_STRIP:
+    case GL_LINE_LOOP:
+        for (int i = 1; i < vertexCount; i++) {
+            addLine(v[i - 1], v[i]);
+        }
+        if (mode == GL_LINE_LOOP && vertexCount > 2) {
+            addLine(v[vertexCount - 1], v[0]);
+        }
+        break;
+    case GL_TRIANGLES:
+        for (int i = 0; i + 2 < vertexCount; i += 3) {
+            addTriangle(v[i], v[i + 1], v[i + 2]);
+        }
+        break;
+    case GL_TRIANGLE_STRIP:
+        for (int i = 2; i < vertexCount; i++) {
+            // every other triangle is flipped to keep the winding of the first
+            if (i % 2 == 0) {
+                addTriangle(v[i - 2], v[i - 1], v[i]);
+            } else {
+                addTriangle(v[i - 1], v[i - 2], v[i]);
+            }
+        }
+        break;
+    case GL_TRIANGLE_FAN:
+        for (int i = 2; i < vertexCount; i++) {
+            addTriangle(v[0], v[i - 1], v[i]);
+        }
+        break;
+    case GL_QUADS:
+        // split like the GL path
+        for (int i = 0; i + 3 < vertexCount; i += 4) {
+            addTriangle(v[i], v[i + 1], v[i + 2]);
+            addTriangle(v[i], v[i + 2], v[i + 3]);
+        }
+        break;
+    default:
+        qWarning() << "GLES1_SoftwareRasterizer: unsupported primitive mode" << mode;
+        break;
+    }
+}
+
+void GLES1_SoftwareRasterizer::clipBounds(int &minX, int &minY, int &maxX, int &maxY) const
+{
+    minX = qMax(0, current.viewport[0]);
+    minY = qMax(0, current.viewport[1]);
+    maxX = qMin(width, current.viewport[0] + current.viewport[2]);
+    maxY = qMin(height, current.viewport[1] + current.viewport[3]);
+    if (current.scissorTest) {
+        minX = qMax(minX, current.scissorBox[0]);
+        minY = qMax(minY, current.scissorBox[1]);
+        maxX = qMin(maxX, current.scissorBox[0] + current.scissorBox[2]);
+        maxY = qMin(maxY, current.scissorBox[1] + current.scissorBox[3]);
+    }
+}
+
+GLES1_SoftwareRasterizer::ScreenVertex GLES1_SoftwareRasterizer::toScreen(const ClipVertex &vertex) const
+{
+    ScreenVertex screen;
+    const float invW = 1 / vertex.position[3];
+    screen.x = snap(current.viewport[0] + (vertex.position[0] * invW + 1) * 0.5f * current.viewport[2]);
+    screen.y = snap(current.viewport[1] + (vertex.position[1] * invW + 1) * 0.5f * current.viewport[3]);
+    screen.z = current.depthRange[0] + (vertex.position[2] * invW + 1) * 0.5f * (current.depthRange[1] - current.depthRange[0]);
+    screen.invW = invW;
+    for (int i = 0; i < 4; i++) {
+        screen.color[i] = vertex.color[i] * invW;
+    }
+    return screen;
+}
+
+void GLES1_SoftwareRasterizer::guardExtent(float *guard) const
+{
+    guard[0] = 1 + 2 * guardBand / qMax(1, current.viewport[2]);
+    guard[1] = 1 + 2 * guardBand / qMax(1, current.viewport[3]);
+}
+
+void GLES1_SoftwareRasterizer::addTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c)
+{
+    // clipped against the near and far planes and the guard band, each plane adds at most one vertex
+    ClipVertex buffers[2][3 + planeCount] = {{a, b, c}, {}};
+    int count = 3;
+    int input = 0;
+    float guard[2];
+    guardExtent(guard);
+    for (int plane = 0; plane < planeCount; plane++) {
+        if (planeDistance(a.position, plane, guard) >= 0 && planeDistance(b.position, plane, guard) >= 0
+                && planeDistance(c.position, plane, guard) >= 0) {
+            // the polygon stays inside a plane all three corners are inside
+            continue;
+        }
+        const ClipVertex * in = buffers[input];
+        ClipVertex * out = buffers[1 - input];
+        int outCount = 0;
+        for (int i = 0; i < count; i++) {
+            const ClipVertex & from = in[i];
+            const ClipVertex & to = in[(i + 1) % count];
+            const float fromDistance = planeDistance(from.position, plane, guard);
+            const float toDistance = planeDistance(to.position, plane, guard);
+            if (fromDistance >= 0) {
+                out[outCount++] = from;
+            }
+            if ((fromDistance >= 0) != (toDistance >= 0)) {
+                const float t = fromDistance / (fromDistance - toDistance);
+                ClipVertex & between = out[outCount++];
+                for (int k = 0; k < 4; k++) {
+                    between.position[k] = from.position[k] + (to.position[k] - from.position[k]) * t;
+                    between.color[k] = from.color[k] + (to.color[k] - from.color[k]) * t;
+                }
+            }
+        }
+        count = outCount;
+        input = 1 - input;
+        if (count < 3) return;
+    }
+
+    const ClipVertex * polygon = buffers[input];
+    for (int i = 0; i < count; i++) {
+        if (!(polygon[i].position[3] > 0)) return;
+    }
+    const ScreenVertex first = toScreen(polygon[0]);
+    ScreenVertex previous = toScreen(polygon[1]);
+    for (int i = 2; i < count; i++) {
+        const ScreenVertex next = toScreen(polygon[i]);
+        setupTriangle(first, previous, next, true);
+        previous = next;
+    }
+}
+
+void GLES1_SoftwareRasterizer::addLine(const ClipVertex &a, const ClipVertex &b)
+{
+    float t0 = 0;
+    float t1 = 1;
+    float guard[2];
+    guardExtent(guard);
+    for (int plane = 0; plane < planeCount; plane++) {
+        const float da = planeDistance(a.position, plane, guard);
+        const float db = planeDistance(b.position, plane, guard);
+        if (da < 0 && db < 0) return;
+        if (da < 0) t0 = qMax(t0, da / (da - db));
+        if (db < 0) t1 = qMin(t1, da / (da - db));
+    }
+    if (t0 > t1) return;
+
+    ClipVertex ends[2];
+    const float t[2] = {t0, t1};
+    for (int end = 0; end < 2; end++) {
+        for (int k = 0; k < 4; k++) {
+            ends[end].position[k] = a.position[k] + (b.position[k] - a.position[k]) * t[end];
+            ends[end].color[k] = a.color[k] + (b.color[k] - a.color[k]) * t[end];
+        }
+        if (!(ends[end].position[3] > 0)) return;
+    }
+
+    const ScreenVertex from = toScreen(ends[0]);
+    const ScreenVertex to = toScreen(ends[1]);
+    // a parallelogram one pixel across the minor axis, so every column or row of a line gets one pixel
+    const bool xMajor = std::fabs(to.x - from.x) >= std::fabs(to.y - from.y);
+    const float offsetX = xMajor ? 0 : 0.5f;
+    const float offsetY = xMajor ? 0.5f : 0;
+    ScreenVertex corners[4] = {from, to, to, from};
+    corners[0].x -= offsetX;
+    corners[0].y -= offsetY;
+    corners[1].x -= offsetX;
+    corners[1].y -= offsetY;
+    corners[2].x += offsetX;
+    corners[2].y += offsetY;
+    corners[3].x += offsetX;
+    corners[3].y += offsetY;
+    addScreenQuad(corners);
+}
+
+void GLES1_SoftwareRasterizer::addPoint(const ClipVertex &a)
+{
+    const float * position = a.position;
+    if (!(position[3] > 0) || position[2] < -position[3] || position[2] > position[3]) return;
+
+    const ScreenVertex center = toScreen(a);
+    ScreenVertex corners[4] = {center, center, center, center};
+    corners[0].x -= 0.5f;
+    corners[0].y -= 0.5f;
+    corners[1].x += 0.5f;
+    corners[1].y -= 0.5f;
+    corners[2].x += 0.5f;
+    corners[2].y += 0.5f;
+    corners[3].x -= 0.5f;
+    corners[3].y += 0.5f;
+    addScreenQuad(corners);
+}
+
+void GLES1_SoftwareRasterizer::addScreenQuad(const ScreenVertex *corners)
+{
+    setupTriangle(corners[0], corners[1], corners[2], false);
+    setupTriangle(corners[0], corners[2], corners[3], false);
+}
+
+void GLES1_SoftwareRasterizer::setupTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, bool cull)
+{
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area == 0 || std::isnan(area)) return;
+    if (area < 0) {
+        // counter clockwise is front facing, only back faces are culled
+        if (cull && current.cullFace) return;
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    int clipMinX, clipMinY, clipMaxX, clipMaxY;
+    clipBounds(clipMinX, clipMinY, clipMaxX, clipMaxY);
+
+    // the pixels whose centers can be inside
+    const float minX = qMin(v0.x, qMin(v1.x, v2.x));
+    const float minY = qMin(v0.y, qMin(v1.y, v2.y));
+    const float maxX = qMax(v0.x, qMax(v1.x, v2.x));
+    const float maxY = qMax(v0.y, qMax(v1.y, v2.y));
+    if (maxX < clipMinX || maxY < clipMinY || minX > clipMaxX || minY > clipMaxY) return;
+
+    // clamped before the conversion, points are not clipped and may lie outside the guard band
+    Triangle triangle;
+    triangle.minX = int(std::ceil(qMax(float(clipMinX), minX) - 0.5f));
+    triangle.minY = int(std::ceil(qMax(float(clipMinY), minY) - 0.5f));
+    triangle.maxX = int(std::floor(qMin(float(clipMaxX), maxX) - 0.5f)) + 1;
+    triangle.maxY = int(std::floor(qMin(float(clipMaxY), maxY) - 0.5f)) + 1;
+    if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY) return;
+
+    const ScreenVertex * v[3] = {&v0, &v1, &v2};
+    for (int i = 0; i < 3; i++) {
+        const ScreenVertex & from = *v[(i + 1) % 3];
+        const ScreenVertex & to = *v[(i + 2) % 3];
+        const float dx = to.x - from.x;
+        const float dy = to.y - from.y;
+        triangle.a[i] = -dy;
+        triangle.b[i] = dx;
+        triangle.c[i] = dy * from.x - dx * from.y;
+        // of two triangles sharing an edge exactly one owns the pixel centers on it
+        const bool owned = dy < 0 || (dy == 0 && dx > 0);
+        triangle.threshold[i] = owned ? 0 : FLT_MIN;
+        triangle.z[i] = v[i]->z;
+        triangle.invW[i] = v[i]->invW;
+        for (int k = 0; k < 4; k++) {
+            triangle.color[i][k] = v[i]->color[k];
+        }
+    }
+    triangle.invArea = 1 / area;
+    triangle.state = states.size() - 1;
+
+    const int index = triangles.size();
+    triangles.append(triangle);
+
+    const int tileMaxX = (triangle.maxX - 1) / tileSize;
+    const int tileMaxY = (triangle.maxY - 1) / tileSize;
+    for (int tileY = triangle.minY / tileSize; tileY <= tileMaxY; tileY++) {
+        for (int tileX = triangle.minX / tileSize; tileX <= tileMaxX; tileX++) {
+            bins[tileY * tilesX + tileX].append(index);
+        }
+    }
+}
+
+void GLES1_SoftwareRasterizer::rasterizeTile(int tile)
+{
+    const int tileX = (tile % tilesX) * tileSize;
+    const int tileY = (tile / tilesX) * tileSize;
+    const Triangle * all = triangles.constData();
+
+    for (int index : bins[tile]) {
+        const Triangle & t = all[index];
+        const State & s = states[t.state];
+        const int x0 = qMax(t.minX, tileX);
+        const int x1 = qMin(t.maxX, tileX + tileSize);
+        const int y0 = qMax(t.minY, tileY);
+        const int y1 = qMin(t.maxY, tileY + tileSize);
+        if (x0 >= x1 || y0 >= y1) continue;
+        // rows are padded, so the four pixels from a multiple of four are always in the buffers
+        const int xStart = x0 & ~3;
+
+        for (int y = y0; y < y1; y++) {
+            const float py = y + 0.5f;
+            float * depthRow = depths.data() + y * stride;
+            for (int x = xStart; x < x1; x += 4) {
+                float weights[3][4];
+                int mask;
+#ifdef GLES1_RASTERIZER_SSE2
+                const __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3, 2, 1, 0));
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(px, _mm_set1_ps(float(x0))), _mm_cmplt_ps(px, _mm_set1_ps(float(x1))));
+                __m128 edges[3];
+                for (int i = 0; i < 3; i++) {
+                    edges[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[i]), px), _mm_set1_ps(t.b[i] * py + t.c[i]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(edges[i], _mm_set1_ps(t.threshold[i])));
+                }
+                mask = _mm_movemask_ps(inside);
+                if (mask == 0) continue;
+
+                const __m128 invArea = _mm_set1_ps(t.invArea);
+                __m128 z = _mm_setzero_ps();
+                for (int i = 0; i < 3; i++) {
+                    const __m128 weight = _mm_mul_ps(edges[i], invArea);
+                    _mm_storeu_ps(weights[i], weight);
+                    z = _mm_add_ps(z, _mm_mul_ps(weight, _mm_set1_ps(t.z[i])));
+                }
+
+                if (s.depthTest) {
+                    const __m128 stored = _mm_loadu_ps(depthRow + x);
+                    mask &= _mm_movemask_ps(depthPasses(z, stored, s.depthFunc));
+                    if (mask == 0) continue;
+                    if (s.depthMask) {
+                        const __m128 write = laneMask(mask);
+                        _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(write, z), _mm_andnot_ps(write, stored)));
+                    }
+                }
+#else
+                mask = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    const int pixel = x + lane;
+                    if (pixel < x0 || pixel >= x1) continue;
+                    const float px = pixel + 0.5f;
+                    bool covered = true;
+                    float z = 0;
+                    for (int i = 0; i < 3; i++) {
+                        const float edge = t.a[i] * px + (t.b[i] * py + t.c[i]);
+                        covered = covered && edge >= t.threshold[i];
+                        weights[i][lane] = edge * t.invArea;
+                        z += weights[i][lane] * t.z[i];
+                    }
+                    if (!covered) continue;
+                    if (s.depthTest) {
+                        if (!depthPasses(z, depthRow[pixel], s.depthFunc)) continue;
+                        if (s.depthMask) depthRow[pixel] = z;
+                    }
+                    mask |= 1 << lane;
+                }
+                if (mask == 0) continue;
+#endif
+                shade(t, s, x, y, weights, mask);
+            }
+        }
+    }
+}
+
+void GLES1_SoftwareRasterizer::shade(const Triangle &triangle, const State &state, int x, int y, const float weights[][4], int lanes)
+{
+    GLubyte * row = colors.data() + (y * stride + x) * 4;
+    for (int lane = 0; lane < 4; lane++) {
+        if (!(lanes & (1 << lane))) continue;
+        const float l0 = weights[0][lane];
+        const float l1 = weights[1][lane];
+        const float l2 = weights[2][lane];
+        const float w = 1 / (l0 * triangle.invW[0] + l1 * triangle.invW[1] + l2 * triangle.invW[2]);
+
+        float source[4];
+        for (int k = 0; k < 4; k++) {
+            const float value = (l0 * triangle.color[0][k] + l1 * triangle.color[1][k] + l2 * triangle.color[2][k]) * w;
+            source[k] = qBound(0.0f, value, 1.0f);
+        }
+
+        GLubyte * pixel = row + lane * 4;
+        float result[4];
+        if (state.blend) {
+            float destination[4];
+            for (int k = 0; k < 4; k++) {
+                destination[k] = pixel[k] / 255.0f;
+            }
+            for (int k = 0; k < 4; k++) {
+                const bool alpha = k == 3;
+                const float sourceFactor = blendFactor(alpha ? state.blendSourceAlpha : state.blendSourceRGB, source, destination, k);
+                const float destinationFactor = blendFactor(alpha ? state.blendDestinationAlpha : state.blendDestinationRGB, source, destination, k);
+                const float value = blendEquation(alpha ? state.blendEquationAlpha : state.blendEquationRGB, source[k], sourceFactor, destination[k], destinationFactor);
+                result[k] = qBound(0.0f, value, 1.0f);
+            }
+        } else {
+            std::memcpy(result, source, sizeof(result));
+        }
+
+        for (int k = 0; k < 4; k++) {
+            if (state.colorMask[k]) pixel[k] = GLubyte(result[k] * 255 + 0.5f);
+        }
+    }
+}
+
+void GLES1_SoftwareRasterizer::finish()
+{
+    if (triangles.isEmpty()) {
+        states.clear();
+        stateChanged = true;
+        return;
+    }
+
+    const int tileCount = tilesX * tilesY;
+    nextTile.storeRelaxed(0);
+    auto work = [this, tileCount]() {
+        for (int tile = nextTile.fetchAndAddRelaxed(1); tile < tileCount; tile = nextTile.fetchAndAddRelaxed(1)) {
+            if (!bins[tile].isEmpty()) rasterizeTile(tile);
+        }
+    };
+
+    // the calling thread works too
+    const int workers = qMin(pool.maxThreadCount(), tileCount) - 1;
+    for (int i = 0; i < workers; i++) {
+        pool.start(work);
+    }
+    work();
+    pool.waitForDone();
+
+    // the bins keep their capacity for the next frame
+    for (QList<int> & bin : bins) {
+        bin.clear();
+    }
+    triangles.clear();
+    states.clear();
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::clear(GLbitfield mask)
+{
+    finish();
+
+    int minX = 0;
+    int minY = 0;
+    int maxX = width;
+    int maxY = height;
+    if (current.scissorTest) {
+        minX = qMax(minX, current.scissorBox[0]);
+        minY = qMax(minY, current.scissorBox[1]);
+        maxX = qMin(maxX, current.scissorBox[0] + current.scissorBox[2]);
+        maxY = qMin(maxY, current.scissorBox[1] + current.scissorBox[3]);
+    }
+    if (minX >= maxX || minY >= maxY) return;
+
+    if (mask & GL_COLOR_BUFFER_BIT) {
+        GLubyte clear[4];
+        for (int k = 0; k < 4; k++) {
+            clear[k] = GLubyte(qBound(0.0f, current.clearColor[k], 1.0f) * 255 + 0.5f);
+        }
+        for (int y = minY; y < maxY; y++) {
+            GLubyte * pixel = colors.data() + (y * stride + minX) * 4;
+            for (int x = minX; x < maxX; x++, pixel += 4) {
+                for (int k = 0; k < 4; k++) {
+                    if (current.colorMask[k]) pixel[k] = clear[k];
+                }
+            }
+        }
+    }
+
+    if ((mask & GL_DEPTH_BUFFER_BIT) && current.depthMask) {
+        const GLfloat clear = qBound(0.0f, current.clearDepth, 1.0f);
+        for (int y = minY; y < maxY; y++) {
+            std::fill(depths.data() + y * stride + minX, depths.data() + y * stride + maxX, clear);
+        }
+    }
+}
+
+const GLubyte *GLES1_SoftwareRasterizer::colorData()
+{
+    finish();
+    return colors.constData();
+}
+
+const GLfloat *GLES1_SoftwareRasterizer::depthData()
+{
+    finish();
+    return depths.constData();
+}
+
+int GLES1_SoftwareRasterizer::getStride() const
+{
+    return stride;
+}
+
+QImage GLES1_SoftwareRasterizer::image()
+{
+    finish();
+    QImage result(width, height, QImage::Format_RGBA8888);
+    for (int y = 0; y < height; y++) {
+        std::memcpy(result.scanLine(height - 1 - y), colors.constData() + y * stride * 4, width * 4);
+    }
+    return result;
+}
+
+const GLES1_SoftwareRasterizer::State &GLES1_SoftwareRasterizer::state() const
+{
+    return current;
+}
+
+bool GLES1_SoftwareRasterizer::isEnabled(GLenum capability) const
+{
+    switch (capability) {
+    case GL_BLEND: return current.blend;
+    case GL_DEPTH_TEST: return current.depthTest;
+    case GL_SCISSOR_TEST: return current.scissorTest;
+    case GL_CULL_FACE: return current.cullFace;
+    default: return false;
+    }
+}
+
+void GLES1_SoftwareRasterizer::setEnabled(GLenum capability, bool enable)
+{
+    switch (capability) {
+    case GL_BLEND: current.blend = enable; break;
+    case GL_DEPTH_TEST: current.depthTest = enable; break;
+    case GL_SCISSOR_TEST: current.scissorTest = enable; break;
+    case GL_CULL_FACE: current.cullFace = enable; break;
+    default: return;
+    }
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+    current.blendSourceRGB = sourceRGB;
+    current.blendDestinationRGB = destinationRGB;
+    current.blendSourceAlpha = sourceAlpha;
+    current.blendDestinationAlpha = destinationAlpha;
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+{
+    current.blendEquationRGB = modeRGB;
+    current.blendEquationAlpha = modeAlpha;
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    current.colorMask[0] = red;
+    current.colorMask[1] = green;
+    current.colorMask[2] = blue;
+    current.colorMask[3] = alpha;
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    current.clearColor[0] = red;
+    current.clearColor[1] = green;
+    current.clearColor[2] = blue;
+    current.clearColor[3] = alpha;
+}
+
+void GLES1_SoftwareRasterizer::depthFunc(GLenum func)
+{
+    current.depthFunc = func;
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::depthMask(GLboolean flag)
+{
+    current.depthMask = flag;
+    stateChanged = true;
+}
+
+void GLES1_SoftwareRasterizer::clearDepth(GLfloat depth)
+{
+    current.clearDepth = depth;
+}
+
+void GLES1_SoftwareRasterizer::setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    current.viewport[0] = x;
+    current.viewport[1] = y;
+    current.viewport[2] = width;
+    current.viewport[3] = height;
+}
+
+void GLES1_SoftwareRasterizer::depthRange(GLfloat nearVal, GLfloat farVal)
+{
+    current.depthRange[0] = qBound(0.0f, nearVal, 1.0f);
+    current.depthRange[1] = qBound(0.0f, farVal, 1.0f);
+}
+
+void GLES1_SoftwareRasterizer::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    current.scissorBox[0] = x;
+    current.scissorBox[1] = y;
+    current.scissorBox[2] = width;
+    current.scissorBox[3] = height;
+    stateChanged = true;
+}
@@ -0,0 +1,158 @@
+#ifndef GLES1_SOFTWARERASTERIZER_H
+#define GLES1_SOFTWARERASTERIZER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QMatrix4x4>
+#include <QOpenGLFunctions>
+#include <QThreadPool>
+
+#include "GLES1_VertexArena.h"
+
+// a cpu backend for GLES1_Wrapper, draws bin triangles into tiles that finish rasterizes on a thread per core,
+// four pixels at a time with SSE2
+//
+// follows the GL path except for texturing and glDrawPixels, lines and points are one pixel wide
+//
+// both buffers are stored bottom up like GL, image returns the colors top down
+
+class GLES1_SoftwareRasterizer
+{
+public:
+
+    static const int tileSize = 64;
+
+    // the GL state a draw is rasterized with, the GL defaults until set
+    struct State {
+        bool blend = false;
+        bool depthTest = false;
+        bool scissorTest = false;
+        bool cullFace = false;
+        GLenum blendSourceRGB = GL_ONE;
+        GLenum blendDestinationRGB = GL_ZERO;
+        GLenum blendSourceAlpha = GL_ONE;
+        GLenum blendDestinationAlpha = GL_ZERO;
+        GLenum blendEquationRGB = GL_FUNC_ADD;
+        GLenum blendEquationAlpha = GL_FUNC_ADD;
+        GLboolean colorMask[4] = {GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE};
+        GLfloat clearColor[4] = {0, 0, 0, 0};
+        GLenum depthFunc = GL_LESS;
+        GLboolean depthMask = GL_TRUE;
+        GLfloat clearDepth = 1;
+        GLint viewport[4] = {0, 0, 0, 0};
+        GLfloat depthRange[2] = {0, 1};
+        GLint scissorBox[4] = {0, 0, 0, 0};
+    };
+
+private:
+
+    // in window coordinates, the color divided by w for perspective correct interpolation
+    struct ScreenVertex {
+        float x;
+        float y;
+        float z;
+        float invW;
+        float color[4];
+    };
+
+    struct ClipVertex {
+        float position[4];
+        float color[4];
+    };
+
+    struct Triangle {
+        // edge i is a * x + b * y + c, covered when every edge is at least its threshold
+        float a[3];
+        float b[3];
+        float c[3];
+        float threshold[3];
+        float invArea;
+        float z[3];
+        float invW[3];
+        float color[3][4];
+        // pixels covered at most, right and top exclusive
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+        int state;
+    };
+
+    int width;
+    int height;
+    // rows are padded to a multiple of four pixels
+    int stride;
+    QList<GLubyte> colors;
+    QList<GLfloat> depths;
+
+    State current;
+    bool stateChanged = true;
+    QList<State> states;
+
+    QList<ClipVertex> clipVertices;
+    QList<Triangle> triangles;
+    QList<QList<int>> bins;
+    int tilesX;
+    int tilesY;
+    QAtomicInt nextTile;
+    QThreadPool pool;
+
+    void clipBounds(int & minX, int & minY, int & maxX, int & maxY) const;
+    void guardExtent(float * guard) const;
+    ScreenVertex toScreen(const ClipVertex & vertex) const;
+    void addTriangle(const ClipVertex & a, const ClipVertex & b, const ClipVertex & c);
+    void addLine(const ClipVertex & a, const ClipVertex & b);
+    void addPoint(const ClipVertex & a);
+    // both triangles of a quad in window coordinates, never culled
+    void addScreenQuad(const ScreenVertex * corners);
+    void setupTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, bool cull);
+    void rasterizeTile(int tile);
+    void shade(const Triangle & triangle, const State & state, int x, int y, const float weights[][4], int lanes);
+
+public:
+
+    GLES1_SoftwareRasterizer(int width, int height);
+    GLES1_SoftwareRasterizer(const GLES1_SoftwareRasterizer &) = delete;
+    GLES1_SoftwareRasterizer & operator=(const GLES1_SoftwareRasterizer &) = delete;
+    ~GLES1_SoftwareRasterizer();
+
+    // drops the contents, the viewport and scissor box are set to the new size
+    void resize(int width, int height);
+    int getWidth() const;
+    int getHeight() const;
+
+    // transforms, clips and bins the vertices of a glBegin/glEnd block, drawn by finish
+    void draw(GLenum mode, const GLES1_Vertex * vertices, int vertexCount, const QMatrix4x4 & projection, const QMatrix4x4 & modelView);
+
+    // rasterizes everything drawn so far
+    void finish();
+
+    // GL_COLOR_BUFFER_BIT and GL_DEPTH_BUFFER_BIT, honouring the scissor test and the masks like glClear
+    void clear(GLbitfield mask);
+
+    // finishes first, the colors as RGBA8 and the window depths, bottom up with getStride pixels per row
+    const GLubyte * colorData();
+    const GLfloat * depthData();
+    int getStride() const;
+
+    // finishes first
+    QImage image();
+
+    // named like those of GLES1_AttribStack, other capabilities than blend, depth, scissor and cull are ignored
+    const State & state() const;
+    bool isEnabled(GLenum capability) const;
+    void setEnabled(GLenum capability, bool enable);
+    void blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+    void blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha);
+    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean flag);
+    void clearDepth(GLfloat depth);
+    void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void depthRange(GLfloat nearVal, GLfloat farVal);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+};
+
+#endif // GLES1_SOFTWARERASTERIZER_H
@@ -0,0 +1,401 @@
+#include "GLES1_Trace.h"
+
+#include "GLES1_Wrapper.h"
+
+const char GLES1_TraceWriter::magic[8] = {'G', 'L', 'E', 'S', '1', 'T', 'R', 'C'};
+
+// payload bytes following each op, indexed by GLES1_TraceOp
+static const int payloadSize[] = {
+    sizeof(quint32),        // Begin
+    0,                      // End
+    0,                      // Flush
+    3 * sizeof(GLfloat),    // Vertex3f
+    4 * sizeof(GLfloat),    // Vertex4f
+    3 * sizeof(GLdouble),   // Vertex3d
+    4 * sizeof(GLdouble),   // Vertex4d
+    4 * sizeof(GLfloat),    // Color4f
+    3 * sizeof(GLfloat),    // Normal3f
+    sizeof(quint32),        // MatrixMode
+    0,                      // LoadIdentity
+    0,                      // PushMatrix
+    0,                      // PopMatrix
+    16 * sizeof(GLfloat),   // LoadMatrixf
+    16 * sizeof(GLdouble),  // LoadMatrixd
+    16 * sizeof(GLfloat),   // MultMatrixf
+    16 * sizeof(GLdouble),  // MultMatrixd
+    16 * sizeof(GLfloat),   // LoadTransposeMatrixf
+    16 * sizeof(GLdouble),  // LoadTransposeMatrixd
+    16 * sizeof(GLfloat),   // MultTransposeMatrixf
+    16 * sizeof(GLdouble),  // MultTransposeMatrixd
+    6 * sizeof(GLdouble),   // Ortho
+    6 * sizeof(GLdouble),   // Frustum
+    4 * sizeof(GLdouble),   // Perspective
+    3 * sizeof(GLfloat),    // Translatef
+    3 * sizeof(GLdouble),   // Translated
+    3 * sizeof(GLfloat),    // Scalef
+    3 * sizeof(GLdouble),   // Scaled
+    4 * sizeof(GLfloat),    // Rotatef
+    4 * sizeof(GLdouble),   // Rotated
+    sizeof(quint32),        // SetDeferredSubmission
+    sizeof(quint32),        // SetVertexDeduplication
+    sizeof(quint32),        // SetMatrixBatching
+    sizeof(quint32),        // RenderMode
+    sizeof(quint32),        // SelectBuffer
+    0,                      // InitNames
+    sizeof(quint32),        // PushName
+    0,                      // PopName
+    sizeof(quint32),        // LoadName
+    sizeof(quint32),        // SetDoublePrecision
+    3 * sizeof(GLdouble),   // SetCameraOrigin
+    sizeof(quint32),        // PushAttrib
+    0,                      // PopAttrib
+    0,                      // BeginFrame
+    0,                      // EndFrame
+    sizeof(quint32),        // SetMaxFramesInFlight
+    sizeof(quint32),        // Enable
+    sizeof(quint32),        // Disable
+    4 * sizeof(quint32),    // BlendFuncSeparate
+    2 * sizeof(quint32),    // BlendEquationSeparate
+    4 * sizeof(quint32),    // ColorMask
+    4 * sizeof(GLfloat),    // ClearColor
+    sizeof(quint32),        // DepthFunc
+    sizeof(quint32),        // DepthMask
+    sizeof(GLdouble),       // ClearDepth
+    2 * sizeof(GLdouble),   // DepthRange
+    4 * sizeof(quint32),    // Viewport
+    4 * sizeof(quint32),    // Scissor
+    sizeof(quint32),        // ActiveTexture
+    2 * sizeof(quint32),    // BindTexture
+    sizeof(quint32),        // Clear
+    4 * sizeof(GLdouble),   // RasterPos4d
+};
+
+static const int opCount = sizeof(payloadSize) / sizeof(payloadSize[0]);
+
+GLES1_TraceWriter::~GLES1_TraceWriter()
+{
+    close();
+}
+
+bool GLES1_TraceWriter::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "GLES1_Wrapper: cannot open trace" << path << file.errorString();
+        return false;
+    }
+    buffer.reserve(bufferSize);
+    buffer.append(magic, sizeof(magic));
+    quint32 v = version;
+    buffer.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    colorRecorded = false;
+    normalRecorded = false;
+    recording = true;
+    return true;
+}
+
+void GLES1_TraceWriter::close()
+{
+    if (!recording) return;
+    writeBuffer();
+    file.close();
+    recording = false;
+}
+
+void GLES1_TraceWriter::writeBuffer()
+{
+    if (file.write(buffer) != buffer.size()) {
+        qWarning() << "GLES1_Wrapper: writing trace failed" << file.errorString();
+    }
+    buffer.resize(0);
+}
+
+GLES1_TraceReader::GLES1_TraceReader(const uchar *data, qint64 size) : cursor(data), end(data + size)
+{
+    quint32 v = 0;
+    valid = size >= static_cast<qint64>(sizeof(GLES1_TraceWriter::magic) + sizeof(v))
+            && memcmp(data, GLES1_TraceWriter::magic, sizeof(GLES1_TraceWriter::magic)) == 0;
+    if (valid) {
+        memcpy(&v, data + sizeof(GLES1_TraceWriter::magic), sizeof(v));
+        valid = v == GLES1_TraceWriter::version;
+        cursor += sizeof(GLES1_TraceWriter::magic) + sizeof(v);
+    }
+}
+
+bool GLES1_TraceReader::isValid() const
+{
+    return valid;
+}
+
+bool GLES1_TraceReader::atEnd() const
+{
+    return !valid || cursor >= end;
+}
+
+bool GLES1_TraceReader::replayFrame(GLES1_Wrapper &wrapper)
+{
+    if (atEnd()) return false;
+
+    GLfloat f[16];
+    GLdouble d[16];
+    quint32 u[4];
+    quint32 u2[2];
+
+    while (cursor < end) {
+        quint8 op = *cursor++;
+        if (op >= opCount || end - cursor < payloadSize[op]) {
+            qWarning() << "GLES1_Wrapper: trace is corrupt or truncated";
+            valid = false;
+            return false;
+        }
+
+        switch (static_cast<GLES1_TraceOp>(op)) {
+        case GLES1_TraceOp::Begin:
+            wrapper.glBegin(readEnum());
+            break;
+        case GLES1_TraceOp::End:
+            wrapper.glEnd();
+            break;
+        case GLES1_TraceOp::Flush:
+            wrapper.flush();
+            if (!framed) return true;
+            break;
+        case GLES1_TraceOp::Vertex3f:
+            memcpy(f, cursor, 3 * sizeof(GLfloat));
+            cursor += 3 * sizeof(GLfloat);
+            wrapper.glVertex3fv(f);
+            break;
+        case GLES1_TraceOp::Vertex4f:
+            memcpy(f, cursor, 4 * sizeof(GLfloat));
+            cursor += 4 * sizeof(GLfloat);
+            wrapper.glVertex4fv(f);
+            break;
+        case GLES1_TraceOp::Vertex3d:
+            memcpy(d, cursor, 3 * sizeof(GLdouble));
+            cursor += 3 * sizeof(GLdouble);
+            wrapper.glVertex3dv(d);
+            break;
+        case GLES1_TraceOp::Vertex4d:
+            memcpy(d, cursor, 4 * sizeof(GLdouble));
+            cursor += 4 * sizeof(GLdouble);
+            wrapper.glVertex4dv(d);
+            break;
+        case GLES1_TraceOp::Color4f:
+            memcpy(f, cursor, 4 * sizeof(GLfloat));
+            cursor += 4 * sizeof(GLfloat);
+            wrapper.glColor4fv(f);
+            break;
+        case GLES1_TraceOp::Normal3f:
+            memcpy(f, cursor, 3 * sizeof(GLfloat));
+            cursor += 3 * sizeof(GLfloat);
+            wrapper.glNormal3f(f[0], f[1], f[2]);
+            break;
+        case GLES1_TraceOp::MatrixMode:
+            wrapper.glMatrixMode(readEnum());
+            break;
+        case GLES1_TraceOp::LoadIdentity:
+            wrapper.glLoadIdentity();
+            break;
+        case GLES1_TraceOp::PushMatrix:
+            wrapper.glPushMatrix();
+            break;
+        case GLES1_TraceOp::PopMatrix:
+            wrapper.glPopMatrix();
+            break;
+        case GLES1_TraceOp::LoadMatrixf:
+            read(f);
+            wrapper.glLoadMatrixf(f);
+            break;
+        case GLES1_TraceOp::LoadMatrixd:
+            read(d);
+            wrapper.glLoadMatrixd(d);
+            break;
+        case GLES1_TraceOp::MultMatrixf:
+            read(f);
+            wrapper.glMultMatrixf(f);
+            break;
+        case GLES1_TraceOp::MultMatrixd:
+            read(d);
+            wrapper.glMultMatrixd(d);
+            break;
+        case GLES1_TraceOp::LoadTransposeMatrixf:
+            read(f);
+            wrapper.glLoadTransposeMatrixf(f);
+            break;
+        case GLES1_TraceOp::LoadTransposeMatrixd:
+            read(d);
+            wrapper.glLoadTransposeMatrixd(d);
+            break;
+        case GLES1_TraceOp::MultTransposeMatrixf:
+            read(f);
+            wrapper.glMultTransposeMatrixf(f);
+            break;
+        case GLES1_TraceOp::MultTransposeMatrixd:
+            read(d);
+            wrapper.glMultTransposeMatrixd(d);
+            break;
+        case GLES1_TraceOp::Ortho:
+            memcpy(d, cursor, 6 * sizeof(GLdouble));
+            cursor += 6 * sizeof(GLdouble);
+            wrapper.glOrtho(d[0], d[1], d[2], d[3], d[4], d[5]);
+            break;
+        case GLES1_TraceOp::Frustum:
+            memcpy(d, cursor, 6 * sizeof(GLdouble));
+            cursor += 6 * sizeof(GLdouble);
+            wrapper.glFrustum(d[0], d[1], d[2], d[3], d[4], d[5]);
+            break;
+        case GLES1_TraceOp::Perspective:
+            memcpy(d, cursor, 4 * sizeof(GLdouble));
+            cursor += 4 * sizeof(GLdouble);
+            wrapper.gluPerspective(d[0], d[1], d[2], d[3]);
+            break;
+        case GLES1_TraceOp::Translatef:
+            memcpy(f, cursor, 3 * sizeof(GLfloat));
+            cursor += 3 * sizeof(GLfloat);
+            wrapper.glTranslatef(f[0], f[1], f[2]);
+            break;
+        case GLES1_TraceOp::Translated:
+            memcpy(d, cursor, 3 * sizeof(GLdouble));
+            cursor += 3 * sizeof(GLdouble);
+            wrapper.glTranslated(d[0], d[1], d[2]);
+            break;
+        case GLES1_TraceOp::Scalef:
+            memcpy(f, cursor, 3 * sizeof(GLfloat));
+            cursor += 3 * sizeof(GLfloat);
+            wrapper.glScalef(f[0], f[1], f[2]);
+            break;
+        case GLES1_TraceOp::Scaled:
+            memcpy(d, cursor, 3 * sizeof(GLdouble));
+            cursor += 3 * sizeof(GLdouble);
+            wrapper.glScaled(d[0], d[1], d[2]);
+            break;
+        case GLES1_TraceOp::Rotatef:
+            memcpy(f, cursor, 4 * sizeof(GLfloat));
+            cursor += 4 * sizeof(GLfloat);
+            wrapper.glRotatef(f[0], f[1], f[2], f[3]);
+            break;
+        case GLES1_TraceOp::Rotated:
+            memcpy(d, cursor, 4 * sizeof(GLdouble));
+            cursor += 4 * sizeof(GLdouble);
+            wrapper.glRotated(d[0], d[1], d[2], d[3]);
+            break;
+        case GLES1_TraceOp::SetDeferredSubmission:
+            wrapper.setDeferredSubmissionEnabled(readEnum() != 0);
+            break;
+        case GLES1_TraceOp::SetVertexDeduplication:
+            wrapper.setVertexDeduplicationEnabled(readEnum() != 0);
+            break;
+        case GLES1_TraceOp::SetMatrixBatching:
+            wrapper.setMatrixBatchingEnabled(readEnum() != 0);
+            break;
+        case GLES1_TraceOp::RenderMode:
+            wrapper.glRenderMode(readEnum());
+            break;
+        case GLES1_TraceOp::SelectBuffer:
+            selectBuffer.resize(readEnum());
+            wrapper.glSelectBuffer(selectBuffer.length(), selectBuffer.data());
+            break;
+        case GLES1_TraceOp::InitNames:
+            wrapper.glInitNames();
+            break;
+        case GLES1_TraceOp::PushName:
+            wrapper.glPushName(readEnum());
+            break;
+        case GLES1_TraceOp::PopName:
+            wrapper.glPopName();
+            break;
+        case GLES1_TraceOp::LoadName:
+            wrapper.glLoadName(readEnum());
+            break;
+        case GLES1_TraceOp::SetDoublePrecision:
+            wrapper.setDoublePrecisionEnabled(readEnum() != 0);
+            break;
+        case GLES1_TraceOp::SetCameraOrigin:
+            memcpy(d, cursor, 3 * sizeof(GLdouble));
+            cursor += 3 * sizeof(GLdouble);
+            wrapper.setCameraOrigin(d[0], d[1], d[2]);
+            break;
+        case GLES1_TraceOp::PushAttrib:
+            wrapper.glPushAttrib(readEnum());
+            break;
+        case GLES1_TraceOp::PopAttrib:
+            wrapper.glPopAttrib();
+            break;
+        case GLES1_TraceOp::BeginFrame:
+            framed = true;
+            wrapper.beginFrame();
+            break;
+        case GLES1_TraceOp::EndFrame:
+            framed = true;
+            wrapper.endFrame();
+            return true;
+        case GLES1_TraceOp::SetMaxFramesInFlight:
+            wrapper.setMaxFramesInFlight(readEnum());
+            break;
+        case GLES1_TraceOp::Enable:
+            wrapper.glEnable(readEnum());
+            break;
+        case GLES1_TraceOp::Disable:
+            wrapper.glDisable(readEnum());
+            break;
+        case GLES1_TraceOp::BlendFuncSeparate:
+            read(u);
+            wrapper.glBlendFuncSeparate(u[0], u[1], u[2], u[3]);
+            break;
+        case GLES1_TraceOp::BlendEquationSeparate:
+            read(u2);
+            wrapper.glBlendEquationSeparate(u2[0], u2[1]);
+            break;
+        case GLES1_TraceOp::ColorMask:
+            read(u);
+            wrapper.glColorMask(u[0], u[1], u[2], u[3]);
+            break;
+        case GLES1_TraceOp::ClearColor:
+            memcpy(f, cursor, 4 * sizeof(GLfloat));
+            cursor += 4 * sizeof(GLfloat);
+            wrapper.glClearColor(f[0], f[1], f[2], f[3]);
+            break;
+        case GLES1_TraceOp::DepthFunc:
+            wrapper.glDepthFunc(readEnum());
+            break;
+        case GLES1_TraceOp::DepthMask:
+            wrapper.glDepthMask(readEnum());
+            break;
+        case GLES1_TraceOp::ClearDepth:
+            memcpy(d, cursor, sizeof(GLdouble));
+            cursor += sizeof(GLdouble);
+            wrapper.glClearDepth(d[0]);
+            break;
+        case GLES1_TraceOp::DepthRange:
+            memcpy(d, cursor, 2 * sizeof(GLdouble));
+            cursor += 2 * sizeof(GLdouble);
+            wrapper.glDepthRange(d[0], d[1]);
+            break;
+        case GLES1_TraceOp::Viewport:
+            read(u);
+            wrapper.glViewport(GLint(u[0]), GLint(u[1]), GLsizei(u[2]), GLsizei(u[3]));
+            break;
+        case GLES1_TraceOp::Scissor:
+            read(u);
+            wrapper.glScissor(GLint(u[0]), GLint(u[1]), GLsizei(u[2]), GLsizei(u[3]));
+            break;
+        case GLES1_TraceOp::ActiveTexture:
+            wrapper.glActiveTexture(readEnum());
+            break;
+        case GLES1_TraceOp::BindTexture:
+            read(u2);
+            wrapper.glBindTexture(u2[0], u2[1]);
+            break;
+        case GLES1_TraceOp::Clear:
+            wrapper.glClear(readEnum());
+            break;
+        case GLES1_TraceOp::RasterPos4d:
+            memcpy(d, cursor, 4 * sizeof(GLdouble));
+            cursor += 4 * sizeof(GLdouble);
+            wrapper.glRasterPos4d(d[0], d[1], d[2], d[3]);
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,212 @@
+#ifndef GLES1_TRACE_H
+#define GLES1_TRACE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QOpenGLFunctions>
+
+#include <cstring>
+
+class GLES1_Wrapper;
+
+// a trace is a header followed by records of an op byte and the fixed size payload of that op
+//
+// colors and normals are recorded when a vertex or a draw uses them, not by every setter
+
+enum class GLES1_TraceOp : quint8
+{
+    Begin,                  // GLenum
+    End,
+    Flush,
+    Vertex3f,               // 3 floats
+    Vertex4f,               // 4 floats
+    Vertex3d,               // 3 doubles
+    Vertex4d,               // 4 doubles
+    Color4f,                // 4 floats
+    Normal3f,               // 3 floats
+    MatrixMode,             // GLenum
+    LoadIdentity,
+    PushMatrix,
+    PopMatrix,
+    LoadMatrixf,            // 16 floats
+    LoadMatrixd,            // 16 doubles
+    MultMatrixf,            // 16 floats
+    MultMatrixd,            // 16 doubles
+    LoadTransposeMatrixf,   // 16 floats
+    LoadTransposeMatrixd,   // 16 doubles
+    MultTransposeMatrixf,   // 16 floats
+    MultTransposeMatrixd,   // 16 doubles
+    Ortho,                  // 6 doubles
+    Frustum,                // 6 doubles
+    Perspective,            // 4 doubles
+    Translatef,             // 3 floats
+    Translated,             // 3 doubles
+    Scalef,                 // 3 floats
+    Scaled,                 // 3 doubles
+    Rotatef,                // 4 floats
+    Rotated,                // 4 doubles
+    SetDeferredSubmission,  // GLenum, 0 or 1
+    SetVertexDeduplication, // GLenum, 0 or 1
+    SetMatrixBatching,      // GLenum, 0 or 1
+    RenderMode,             // GLenum
+    SelectBuffer,           // GLenum, the size, replay uses a buffer of its own
+    InitNames,
+    PushName,               // GLenum
+    PopName,
+    LoadName,               // GLenum
+    SetDoublePrecision,     // GLenum, 0 or 1
+    SetCameraOrigin,        // 3 doubles
+    PushAttrib,             // GLenum, the mask
+    PopAttrib,
+    BeginFrame,
+    EndFrame,
+    SetMaxFramesInFlight,   // GLenum
+    // the state setters, glBlendFunc and glBlendEquation as their separate forms
+    Enable,                 // GLenum
+    Disable,                // GLenum
+    BlendFuncSeparate,      // 4 GLenums
+    BlendEquationSeparate,  // 2 GLenums
+    ColorMask,              // 4 GLenums, 0 or 1
+    ClearColor,             // 4 floats
+    DepthFunc,              // GLenum
+    DepthMask,              // GLenum, 0 or 1
+    ClearDepth,             // double
+    DepthRange,             // 2 doubles
+    Viewport,               // 4 GLenums, x, y, width and height
+    Scissor,                // 4 GLenums, x, y, width and height
+    ActiveTexture,          // GLenum
+    BindTexture,            // 2 GLenums, the target and the name
+    Clear,                  // GLenum, the mask
+    RasterPos4d,            // 4 doubles
+};
+
+class GLES1_TraceWriter
+{
+    QFile file;
+    QByteArray buffer;
+    bool recording = false;
+
+    // recorded on use, see above
+    GLfloat color[4];
+    GLfloat normal[3];
+    bool colorRecorded;
+    bool normalRecorded;
+
+    void writeBuffer();
+
+    inline char * reserve(int size) {
+        if (Q_UNLIKELY(buffer.size() + size > bufferSize)) writeBuffer();
+        int at = buffer.size();
+        buffer.resize(at + size);
+        return buffer.data() + at;
+    }
+
+public:
+
+    static const char magic[8];
+    static const quint32 version = 1;
+
+    // records are written to the file whenever this many bytes are pending
+    static const int bufferSize = 1024 * 1024;
+
+    ~GLES1_TraceWriter();
+
+    bool open(const QString & path);
+    void close();
+
+    inline bool isRecording() const { return recording; }
+
+    inline void record(GLES1_TraceOp op) {
+        *reserve(1) = static_cast<char>(op);
+    }
+
+    inline void record(GLES1_TraceOp op, GLenum value) {
+        quint32 v = value;
+        char * out = reserve(1 + sizeof(v));
+        *out = static_cast<char>(op);
+        memcpy(out + 1, &v, sizeof(v));
+    }
+
+    template <typename T>
+    inline void record(GLES1_TraceOp op, const T * values, int count) {
+        char * out = reserve(1 + count * sizeof(T));
+        *out = static_cast<char>(op);
+        memcpy(out + 1, values, count * sizeof(T));
+    }
+
+    template <typename T>
+    inline void record(GLES1_TraceOp op, T a, T b, T c) {
+        const T values[] = {a, b, c};
+        record(op, values, 3);
+    }
+
+    template <typename T>
+    inline void record(GLES1_TraceOp op, T a, T b, T c, T d) {
+        const T values[] = {a, b, c, d};
+        record(op, values, 4);
+    }
+
+    inline void recordColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+        if (colorRecorded && color[0] == red && color[1] == green && color[2] == blue && color[3] == alpha) return;
+        color[0] = red;
+        color[1] = green;
+        color[2] = blue;
+        color[3] = alpha;
+        colorRecorded = true;
+        record(GLES1_TraceOp::Color4f, color, 4);
+    }
+
+    inline void recordNormal(GLfloat x, GLfloat y, GLfloat z) {
+        if (normalRecorded && normal[0] == x && normal[1] == y && normal[2] == z) return;
+        normal[0] = x;
+        normal[1] = y;
+        normal[2] = z;
+        normalRecorded = true;
+        record(GLES1_TraceOp::Normal3f, normal, 3);
+    }
+
+    // after a recorded glPopAttrib restored the color and normal, replay no longer holds the ones recorded last
+    inline void forgetCurrent() {
+        colorRecorded = false;
+        normalRecorded = false;
+    }
+};
+
+// replays a trace held in memory, typically a mapped file
+class GLES1_TraceReader
+{
+    const uchar * cursor;
+    const uchar * end;
+    bool valid;
+    QList<GLuint> selectBuffer;
+    // set once the trace is seen to use frames, flushes no longer end one then
+    bool framed = false;
+
+    template <typename T, int N>
+    inline void read(T (&values)[N]) {
+        memcpy(values, cursor, sizeof(values));
+        cursor += sizeof(values);
+    }
+
+    inline GLenum readEnum() {
+        quint32 v;
+        memcpy(&v, cursor, sizeof(v));
+        cursor += sizeof(v);
+        return v;
+    }
+
+public:
+
+    GLES1_TraceReader(const uchar * data, qint64 size);
+
+    // false if the header does not match the format written by GLES1_TraceWriter
+    bool isValid() const;
+    bool atEnd() const;
+
+    // replays up to an endFrame, or a flush in traces without frames,
+    // false if nothing was left or the trace is corrupt
+    bool replayFrame(GLES1_Wrapper & wrapper);
+};
+
+#endif // GLES1_TRACE_H
@@ -0,0 +1,84 @@
+#include "GLES1_VertexArena.h"
+
+#include "GLES1_MemoryAccounting.h"
+
+#include <cstdlib>
+#include <cstring>
+
+GLES1_VertexArena::~GLES1_VertexArena()
+{
+    free(vertices);
+    GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::Staging, capacityBytes(), vertices != nullptr ? 1 : 0);
+}
+
+void GLES1_VertexArena::reallocate(int newCapacity)
+{
+    GLES1_Vertex * grown = static_cast<GLES1_Vertex*>(realloc(vertices, newCapacity * sizeof(GLES1_Vertex)));
+    if (grown == nullptr) {
+        qFatal("GLES1_Wrapper: out of memory staging %d vertices", newCapacity);
+    }
+    GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::Staging, qint64(newCapacity - capacity) * qint64(sizeof(GLES1_Vertex)), vertices == nullptr ? 1 : 0);
+    vertices = grown;
+    capacity = newCapacity;
+    allocations++;
+}
+
+void GLES1_VertexArena::grow()
+{
+    reallocate(capacity == 0 ? initialCapacity : capacity * 2);
+}
+
+void GLES1_VertexArena::append(const GLES1_Vertex *source, int sourceCount)
+{
+    if (count + sourceCount > capacity) {
+        int grown = capacity == 0 ? initialCapacity : capacity;
+        while (grown < count + sourceCount) {
+            grown *= 2;
+        }
+        reallocate(grown);
+    }
+    memcpy(vertices + count, source, sourceCount * sizeof(GLES1_Vertex));
+    count += sourceCount;
+    // not inspected, assume both vary
+    colorChange = count - 1;
+    projectiveVertex = count - 1;
+}
+
+void GLES1_VertexArena::reset()
+{
+    highWaterMark = qMax(highWaterMark, count);
+    clear();
+    if (++blocksSinceTrim < trimInterval) return;
+
+    if (capacity > initialCapacity && highWaterMark * 2 < capacity) {
+        int trimmed = initialCapacity;
+        while (trimmed < highWaterMark) {
+            trimmed *= 2;
+        }
+        reallocate(trimmed);
+        trims++;
+    }
+    highWaterMark = 0;
+    blocksSinceTrim = 0;
+}
+
+quint64 GLES1_VertexArena::allocationCount() const
+{
+    return allocations;
+}
+
+quint64 GLES1_VertexArena::trimCount() const
+{
+    return trims;
+}
+
+size_t GLES1_VertexArena::capacityBytes() const
+{
+    return capacity * sizeof(GLES1_Vertex);
+}
+
+void GLES1_VertexArena::resetCounters()
+{
+    allocations = 0;
+    trims = 0;
+}
@@ -0,0 +1,98 @@
+#ifndef GLES1_VERTEXARENA_H
+#define GLES1_VERTEXARENA_H
+
+#include <QOpenGLFunctions>
+
+// the layout of a staged vertex, uploaded as is
+struct GLES1_Vertex
+{
+    GLfloat x;
+    GLfloat y;
+    GLfloat z;
+    GLfloat w;
+    GLfloat red;
+    GLfloat green;
+    GLfloat blue;
+    GLfloat alpha;
+};
+
+// staging memory for the vertices of a glBegin/glEnd block, the capacity is kept between blocks
+// and only trimmed when the largest of the last trimInterval blocks fits in half of it
+//
+// appending tracks the last color change and the last w other than 1, see isColorConstant and isAffine
+
+class GLES1_VertexArena
+{
+    GLES1_Vertex * vertices = nullptr;
+    int count = 0;
+    int capacity = 0;
+
+    // -1 if none since the last clear or reset
+    int colorChange = -1;
+    int projectiveVertex = -1;
+
+    int highWaterMark = 0;
+    int blocksSinceTrim = 0;
+
+    quint64 allocations = 0;
+    quint64 trims = 0;
+
+    void reallocate(int newCapacity);
+    void grow();
+
+public:
+
+    static const int initialCapacity = 1024;
+    static const int trimInterval = 256;
+
+    GLES1_VertexArena() = default;
+    GLES1_VertexArena(const GLES1_VertexArena &) = delete;
+    GLES1_VertexArena & operator=(const GLES1_VertexArena &) = delete;
+    ~GLES1_VertexArena();
+
+    inline void append(GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+        if (Q_UNLIKELY(count == capacity)) grow();
+        if (count > 0) {
+            const GLES1_Vertex & previous = vertices[count - 1];
+            if (previous.red != red || previous.green != green || previous.blue != blue || previous.alpha != alpha) {
+                colorChange = count;
+            }
+        }
+        if (w != 1) projectiveVertex = count;
+        GLES1_Vertex & v = vertices[count++];
+        v.x = x;
+        v.y = y;
+        v.z = z;
+        v.w = w;
+        v.red = red;
+        v.green = green;
+        v.blue = blue;
+        v.alpha = alpha;
+    }
+
+    void append(const GLES1_Vertex * source, int sourceCount);
+
+    inline const GLES1_Vertex * data() const { return vertices; }
+    inline int size() const { return count; }
+
+    // whether the vertices from first to the end share their color, and all have a w of 1
+    inline bool isColorConstant(int first) const { return colorChange <= first; }
+    inline bool isAffine(int first) const { return projectiveVertex < first; }
+
+    // drops the staged vertices without touching the trim policy
+    inline void clear() {
+        count = 0;
+        colorChange = -1;
+        projectiveVertex = -1;
+    }
+
+    // ends a block, dropping the staged vertices and applying the trim policy
+    void reset();
+
+    quint64 allocationCount() const;
+    quint64 trimCount() const;
+    size_t capacityBytes() const;
+    void resetCounters();
+};
+
+#endif // GLES1_VERTEXARENA_H
@@ -1,42 +1,22 @@
 #include "GLES1_Wrapper.h"
 
-#include <QOpenGLBuffer>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
-const char * GLES1_Wrapper::vertex_shader = R"(
-layout (location = 0) in vec4 vertex_position;
-layout (location = 1) in vec4 vertex_color;
-uniform mat4 projection;
-uniform mat4 modelView;
-uniform vec3 normal;
-
-out vec4 fragment_in_color;
-
-void main()
-{
-    gl_Position = projection * modelView * vertex_position;
-    fragment_in_color = vertex_color;
-}
-)";
-
-const char * GLES1_Wrapper::fragment_shader = R"(
-// input
-in highp vec4 fragment_in_color;
-
-// output
-out highp vec4 FragColor;
-
-// code
-void main() {
-    FragColor = fragment_in_color;
-}
-)";
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 void GLES1_Wrapper::glBegin(GLenum mode)
 {
     if (begin) return;
-    vertexCount = 0;
-    vertexData.clear();
-    vertexData.squeeze();
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Begin, mode);
+    if (!deferredSubmission) {
+        staging.clear();
+    }
+    // deferred blocks accumulate in staging until flush
+    blockStart = staging.size();
     primitiveMode = mode;
     begin = true;
 }
@@ -44,81 +24,574 @@ void GLES1_Wrapper::glBegin(GLenum mode)
 void GLES1_Wrapper::glEnd()
 {
     if (!begin) return;
-    shader.bind();
-    GLuint VAO;
-    GLuint VBO;
-    gles3->glGenVertexArrays(1, &VAO);
-    gles2->glGenBuffers(1, &VBO);
-    gles3->glBindVertexArray(VAO);
-    gles2->glBindBuffer(GL_ARRAY_BUFFER, VBO);
-//    qDebug() << "set vertex buffer data to" << vertexData;
-    gles2->glBufferData(GL_ARRAY_BUFFER, vertexData.length() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
+    if (trace.isRecording()) {
+        trace.recordNormal(currentNormal.x(), currentNormal.y(), currentNormal.z());
+        trace.record(GLES1_TraceOp::End);
+    }
+    begin = false;
 
-    int position_components = 4;
-    int color_components = 4;
-    int vertex_position_of_position = 0;
-    int vertex_position_of_color = position_components * sizeof(float);
-    int stride = position_components + color_components;
+    if (renderMode == GL_SELECT) {
+        selection.addBlock(primitiveMode, staging.data() + blockStart, staging.size() - blockStart,
+                           stack_GL_MODELVIEW_MATRIX.last(), stack_GL_PROJECTION_MATRIX.last());
+        staging.reset();
+        return;
+    }
+
+    if (software != nullptr) {
+        GLsizei vertexCount = staging.size() - blockStart;
+        stats.verticesSubmitted += vertexCount;
+        stats.drawCalls++;
+        software->draw(primitiveMode, staging.data() + blockStart, vertexCount,
+                       stack_GL_PROJECTION_MATRIX.last(), stack_GL_MODELVIEW_MATRIX.last());
+        staging.reset();
+        return;
+    }
+
+    if (deferredSubmission) {
+        queueDrawPacket();
+        return;
+    }
+
+    QOpenGLShaderProgram * shader = program->shader;
+    shader->bind();
+    gles3->glBindVertexArray(VAO);
 
     GLboolean isNormalizationEnabled = glIsEnabled(GL_NORMALIZE);
 
+    shader->setUniformValue(program->projectionUniform, stack_GL_PROJECTION_MATRIX.last());
+    shader->setUniformValue(program->modelViewUniform, stack_GL_MODELVIEW_MATRIX.last());
+    shader->setUniformValue(program->normalUniform, currentNormal);
+
+    drawVertices(primitiveMode, staging.data(), staging.size(), stagedLayout(0));
+
+    gles3->glBindVertexArray(0);
+    shader->release();
+
+    // clean up, the staging capacity is kept for the next block
+    staging.reset();
+}
+
+const GLES1_Wrapper::VertexLayout GLES1_Wrapper::fullLayout = {false, false, {0, 0, 0, 0}};
+
+GLES1_Wrapper::VertexLayout GLES1_Wrapper::stagedLayout(int first)
+{
+    VertexLayout layout;
+    layout.affine = staging.isAffine(first);
+    layout.constantColor = staging.isColorConstant(first) && first < staging.size();
+    if (layout.constantColor) {
+        const GLES1_Vertex & v = staging.data()[first];
+        layout.color[0] = v.red;
+        layout.color[1] = v.green;
+        layout.color[2] = v.blue;
+        layout.color[3] = v.alpha;
+    } else {
+        layout.color[0] = layout.color[1] = layout.color[2] = layout.color[3] = 0;
+    }
+    return layout;
+}
+
+void GLES1_Wrapper::packVertices(GLfloat *destination, const GLES1_Vertex *vertices, GLsizei vertexCount, const VertexLayout &layout)
+{
+    if (!layout.affine && !layout.constantColor) {
+        memcpy(destination, vertices, vertexCount * sizeof(GLES1_Vertex));
+        return;
+    }
+    for (GLsizei i = 0; i < vertexCount; i++) {
+        const GLES1_Vertex & v = vertices[i];
+        *destination++ = v.x;
+        *destination++ = v.y;
+        *destination++ = v.z;
+        if (!layout.affine) {
+            *destination++ = v.w;
+        }
+        if (!layout.constantColor) {
+            *destination++ = v.red;
+            *destination++ = v.green;
+            *destination++ = v.blue;
+            *destination++ = v.alpha;
+        }
+    }
+}
+
+GLintptr GLES1_Wrapper::uploadVertices(const GLES1_Vertex *vertices, GLsizei vertexCount, const VertexLayout &layout)
+{
+    GLsizeiptr size = vertexCount * layout.stride();
+    GLintptr offset;
+    void * destination = streamMap(vertexStream, GL_ARRAY_BUFFER, size, 16, offset);
+    if (destination != nullptr) {
+        // packed straight into the mapping
+        packVertices(static_cast<GLfloat*>(destination), vertices, vertexCount, layout);
+        gles3->glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    stats.vertexBytesUploaded += size;
+    return offset;
+}
+
+void GLES1_Wrapper::setVertexAttributes(GLintptr vertexOffset, const VertexLayout &layout)
+{
+    int position_components = layout.affine ? 3 : 4;
+    int color_components = 4;
+    int vertex_position_of_color = position_components * sizeof(GLfloat);
+    int stride = layout.stride();
+
     // position attribute
-    gles2->glVertexAttribPointer(0, position_components, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)vertex_position_of_position);
-    gles2->glEnableVertexAttribArray(0);
+    gles2->glVertexAttribPointer(0, position_components, GL_FLOAT, GL_FALSE, stride, (void*)vertexOffset);
 
-    // color attribute
-    gles2->glVertexAttribPointer(1, color_components, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)vertex_position_of_color);
-    gles2->glEnableVertexAttribArray(1);
+    // color attribute, a constant one when every vertex has the same color
+    if (layout.constantColor) {
+        gles2->glDisableVertexAttribArray(1);
+        gles2->glVertexAttrib4f(1, layout.color[0], layout.color[1], layout.color[2], layout.color[3]);
+    } else {
+        gles2->glEnableVertexAttribArray(1);
+        gles2->glVertexAttribPointer(1, color_components, GL_FLOAT, GL_FALSE, stride, (void*)(vertexOffset + vertex_position_of_color));
+    }
+}
 
-    shader.setUniformValue(projectionUniform, stack_GL_PROJECTION_MATRIX.last());
-    shader.setUniformValue(modelViewUniform, stack_GL_MODELVIEW_MATRIX.last());
-    shader.setUniformValue(normalUniform, currentNormal);
-
-    if (primitiveMode == GL_QUADS) {
-        // calculate quad elements index array
-        QList<int> elements;
-        auto c = vertexData.length();
-        qsizetype i = 0;
-        int p = 0;
-        auto increment = stride * 4;
-        while(i < c) {
-            int i0 = p++;
-            int i1 = p++;
-            int i2 = p++;
-            int i3 = p++;
-            elements.append({
-                i0, i1, i2,
-                i0, i2, i3
-            });
-            i += increment;
+void GLES1_Wrapper::drawVertices(GLenum mode, const GLES1_Vertex *vertices, GLsizei vertexCount, const VertexLayout &layout)
+{
+    stats.verticesSubmitted += vertexCount;
+
+    if (vertexDeduplication && indexedMesh.build(mode, vertices, vertexCount)) {
+        GLsizei uploadCount = indexedMesh.vertexCount;
+        stats.verticesUploaded += uploadCount;
+        setVertexAttributes(uploadVertices(indexedMesh.vertices.data(), uploadCount, layout), layout);
+
+        auto elementCount = indexedMesh.indices.length();
+        GLintptr indexOffset = streamUpload(indexStream, GL_ELEMENT_ARRAY_BUFFER, indexedMesh.indices.data(), elementCount * sizeof(GLuint));
+        stats.indicesUploaded += elementCount;
+        stats.drawCalls++;
+        gles2->glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, (void*)indexOffset);
+        return;
+    }
+
+    stats.verticesUploaded += vertexCount;
+    drawUploaded(mode, uploadVertices(vertices, vertexCount, layout), vertexCount, layout);
+}
+
+void GLES1_Wrapper::drawUploaded(GLenum mode, GLintptr vertexOffset, GLsizei vertexCount, const VertexLayout &layout)
+{
+    setVertexAttributes(vertexOffset, layout);
+    stats.drawCalls++;
+
+    if (mode == GL_QUADS) {
+        // the shared quad index buffer already holds the two triangles of every quad
+        int quadCount = vertexCount / 4;
+        gles2->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources->quadIndexBuffer(gles2, quadCount));
+        gles2->glDrawElements(GL_TRIANGLES, quadCount * 6, GL_UNSIGNED_INT, 0);
+    } else {
+        gles2->glDrawArrays(mode, 0, vertexCount);
+    }
+}
+
+GLES1_Wrapper::DrawState GLES1_Wrapper::captureDrawState()
+{
+    // from the shadow, querying GL would stall every deferred glEnd
+    DrawState state;
+    state.texture = attribs.getTexture2D();
+    state.raster = attribs.snapshot();
+    return state;
+}
+
+void GLES1_Wrapper::applyDrawState(const DrawState &state, DrawState &current)
+{
+    // through the shadow so that it stays current
+    if (state.texture != current.texture) {
+        attribs.bindTexture(GL_TEXTURE_2D, state.texture);
+        stats.stateChanges++;
+    }
+    if (!(state.raster == current.raster)) {
+        attribs.restore(state.raster);
+        stats.stateChanges++;
+    }
+    current = state;
+}
+
+int GLES1_Wrapper::snapshotMatrix(const QMatrix4x4 &matrix, int previous)
+{
+    // consecutive blocks usually share their matrices
+    if (previous >= 0 && frameMatrices[previous] == matrix) return previous;
+    frameMatrices.append(matrix);
+    return frameMatrices.length() - 1;
+}
+
+void GLES1_Wrapper::queueDrawPacket()
+{
+    DrawPacket packet;
+    packet.mode = primitiveMode;
+    packet.firstVertex = blockStart;
+    packet.vertexCount = staging.size() - blockStart;
+    if (packet.vertexCount == 0) return;
+    packet.variant = 0;
+    packet.state = captureDrawState();
+    int previousProjection = drawQueue.isEmpty() ? -1 : drawQueue.last().projection;
+    int previousModelView = drawQueue.isEmpty() ? -1 : drawQueue.last().modelView;
+    packet.projection = snapshotMatrix(stack_GL_PROJECTION_MATRIX.last(), previousProjection);
+    packet.modelView = snapshotMatrix(stack_GL_MODELVIEW_MATRIX.last(), previousModelView);
+    packet.normal = currentNormal;
+    packet.layout = stagedLayout(blockStart);
+    drawQueue.append(packet);
+    stats.packetsQueued++;
+}
+
+static int primitiveSize(GLenum mode)
+{
+    switch (mode) {
+    case GL_POINTS:
+        return 1;
+    case GL_LINES:
+        return 2;
+    case GL_TRIANGLES:
+        return 3;
+    case GL_QUADS:
+        return 4;
+    default:
+        // strips, fans and loops connect every vertex to the previous ones
+        return 0;
+    }
+}
+
+bool GLES1_Wrapper::isReorderable(const DrawPacket &packet)
+{
+    // only a depth test that writes and keeps the nearest or farthest fragment makes the order irrelevant,
+    // blending, stencil and partial color masks depend on what was drawn before
+    const GLES1_AttribStack::Snapshot & raster = packet.state.raster;
+    if (raster.isEnabled(GL_BLEND) || raster.isEnabled(GL_STENCIL_TEST)) return false;
+    if (!raster.isEnabled(GL_DEPTH_TEST) || !raster.depthMask) return false;
+    for (GLboolean channel : raster.colorMask) {
+        if (!channel) return false;
+    }
+    switch (raster.depthFunc) {
+    case GL_LESS:
+    case GL_LEQUAL:
+    case GL_GREATER:
+    case GL_GEQUAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool GLES1_Wrapper::sortsBefore(const DrawPacket &a, const DrawPacket &b, bool matrixBatching)
+{
+    // most expensive change first
+    if (a.variant != b.variant) return a.variant < b.variant;
+    if (a.state.texture != b.state.texture) return a.state.texture < b.state.texture;
+    if (a.state.raster.depthMask != b.state.raster.depthMask) return a.state.raster.depthMask < b.state.raster.depthMask;
+    if (a.projection != b.projection) return a.projection < b.projection;
+    // a modelview change does not end a matrix batch, a primitive mode change does
+    if (matrixBatching && a.mode != b.mode) return a.mode < b.mode;
+    if (a.modelView != b.modelView) return a.modelView < b.modelView;
+    return a.mode < b.mode;
+}
+
+bool GLES1_Wrapper::canMerge(const DrawPacket &a, GLsizei mergedCount, const DrawPacket &b, bool matrixBatching)
+{
+    int size = primitiveSize(a.mode);
+    return size != 0
+            && a.mode == b.mode
+            && mergedCount % size == 0
+            && a.variant == b.variant
+            && a.state == b.state
+            && a.projection == b.projection
+            && (matrixBatching || a.modelView == b.modelView)
+            && a.normal == b.normal;
+}
+
+void GLES1_Wrapper::flush()
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Flush);
+    if (software != nullptr) {
+        software->finish();
+        return;
+    }
+    drawDeferred();
+}
+
+void GLES1_Wrapper::exchangeStreams(GLES1_StreamBuffer *streams)
+{
+    std::swap(vertexStream, streams[0]);
+    std::swap(indexStream, streams[1]);
+    std::swap(matrixIndexStream, streams[2]);
+    std::swap(uniformStream, streams[3]);
+}
+
+void GLES1_Wrapper::retireFrames(int keep)
+{
+    int retries = 0;
+    while (!framesInFlight.isEmpty()) {
+        FrameInFlight & oldest = framesInFlight.first();
+        bool wait = framesInFlight.length() > keep;
+        GLenum status = gles3->glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? frameWaitTimeout : 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            if (!wait) return;
+            if (++retries < frameWaitRetries) continue;
+            qWarning() << "GLES1_Wrapper: a frame fence did not signal within" << frameWaitRetries * frameWaitTimeout / 1000000 << "ms";
+        } else if (status == GL_WAIT_FAILED) {
+            qWarning() << "GLES1_Wrapper: waiting for a frame fence failed";
         }
+        retries = 0;
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            // nothing says the gpu is done with the buffers, orphan them before writing again
+            for (GLES1_StreamBuffer & stream : oldest.streams) {
+                stream.offset = stream.capacity;
+            }
+        } else {
+            stats.framesRetired++;
+            stats.gpuLagNanoseconds += frameClock.nsecsElapsed() - oldest.submitted;
+            for (GLES1_StreamBuffer & stream : oldest.streams) {
+                stream.offset = 0;
+            }
+        }
+        gles3->glDeleteSync(oldest.fence);
+        oldest.fence = nullptr;
+        recycledFrames.append(framesInFlight.takeFirst());
+    }
+}
+
+void GLES1_Wrapper::beginFrame()
+{
+    if (begin || inFrame) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::BeginFrame);
+    inFrame = true;
+    if (software != nullptr) return;
 
-        unsigned int EBO;
-        gles2->glGenBuffers(1, &EBO);
+    qint64 waitStart = frameClock.nsecsElapsed();
+    retireFrames(maxFramesInFlight - 1);
+    stats.cpuWaitNanoseconds += frameClock.nsecsElapsed() - waitStart;
+}
 
-        gles2->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-//        qDebug() << "set element buffer data to" << elements;
-        gles2->glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), elements.data(), GL_STATIC_DRAW);
+void GLES1_Wrapper::endFrame()
+{
+    if (begin || !inFrame) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::EndFrame);
+    inFrame = false;
+    stats.frames++;
+    if (software != nullptr) {
+        software->finish();
+        return;
+    }
 
-        gles2->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        auto elementCount = elements.length();
-        qDebug() << "drawing" << elementCount << "elements";
-        gles2->glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0);
+    // the fence must follow every draw of the frame
+    drawDeferred();
+    FrameInFlight frame;
+    frame.fence = gles3->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.submitted = frameClock.nsecsElapsed();
+
+    // whatever is drawn until the next endFrame goes into a set the gpu is done with, or a new one
+    retireFrames(framesInFlight.length() + 1);
+    if (!recycledFrames.isEmpty()) {
+        FrameInFlight recycled = recycledFrames.takeLast();
+        std::copy(recycled.streams, recycled.streams + 4, frame.streams);
     } else {
-        qDebug() << "drawing" << vertexCount << "vertices";
-        gles2->glDrawArrays(primitiveMode, 0, vertexCount);
+        for (GLES1_StreamBuffer & stream : frame.streams) {
+            stream = resources->takeStreamBuffer(gles2);
+        }
     }
+    exchangeStreams(frame.streams);
+    framesInFlight.append(frame);
+}
 
-    gles3->glDeleteVertexArrays(1, &VAO);
-    gles2->glDeleteBuffers(1, &VBO);
-    shader.release();
+void GLES1_Wrapper::setMaxFramesInFlight(int frames)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetMaxFramesInFlight, GLenum(frames));
+    maxFramesInFlight = qBound(1, frames, 3);
+}
 
-    // clean up
-    vertexCount = 0;
-    vertexData.clear();
-    vertexData.squeeze();
+int GLES1_Wrapper::getMaxFramesInFlight()
+{
+    return maxFramesInFlight;
+}
 
-    begin = false;
+void GLES1_Wrapper::drawDeferred()
+{
+    if (begin || drawQueue.isEmpty()) return;
+
+    // sort each run of order independent packets, every other packet stays where it was submitted
+    drawOrder.resize(drawQueue.length());
+    for (int i = 0; i < drawQueue.length(); i++) {
+        drawOrder[i] = i;
+    }
+    // per vertex matrix indices are not carried through deduplication
+    const GLES1_Program * batchProgram = nullptr;
+    if (matrixBatching && !vertexDeduplication) {
+        batchProgram = resources->program(context, GLES1_SharedResources::MatrixArrayVariant);
+    }
+    bool batching = batchProgram != nullptr;
+
+    auto sortRun = [this, batching](int first, int last) {
+        std::stable_sort(drawOrder.begin() + first, drawOrder.begin() + last, [this, batching](int a, int b) {
+            return sortsBefore(drawQueue[a], drawQueue[b], batching);
+        });
+    };
+    int runStart = 0;
+    for (int i = 0; i <= drawQueue.length(); i++) {
+        if (i == drawQueue.length() || !isReorderable(drawQueue[i])) {
+            sortRun(runStart, i);
+            runStart = i + 1;
+        }
+    }
+
+    // merge neighbours with identical state into single draws, laying their vertices out contiguously
+    // when batching, a merged draw collects the distinct modelviews of its packets
+    mergedDraws.clear();
+    deferredVertices.clear();
+    batchMatrices.clear();
+    matrixIndices.clear();
+    // every batch starts at an offset glBindBufferRange accepts
+    int matrixAlignment = qMax(1, (uniformAlignment + 63) / 64);
+    bool batched = false;
+    for (int i : drawOrder) {
+        const DrawPacket & packet = drawQueue[i];
+        const GLES1_Vertex * vertices = staging.data() + packet.firstVertex;
+        bool merged = false;
+        if (!mergedDraws.isEmpty() && canMerge(drawQueue[mergedDraws.last().packet], mergedDraws.last().vertexCount, packet, batching)) {
+            MergedDraw & draw = mergedDraws.last();
+            if (batchMatrices[draw.firstMatrix + draw.matrixCount - 1] == packet.modelView) {
+                merged = true;
+            } else if (draw.matrixCount < GLES1_SharedResources::modelViewArraySize) {
+                batchMatrices.append(packet.modelView);
+                draw.matrixCount++;
+                batched = true;
+                merged = true;
+            } else {
+                stats.matrixBatchSplits++;
+            }
+            if (merged) {
+                draw.vertexCount += packet.vertexCount;
+                draw.layout.merge(packet.layout);
+            }
+        }
+        if (!merged) {
+            if (batching) {
+                while (batchMatrices.length() % matrixAlignment != 0) {
+                    batchMatrices.append(packet.modelView);
+                }
+            }
+            MergedDraw draw;
+            draw.packet = i;
+            draw.firstVertex = deferredVertices.size();
+            draw.vertexCount = packet.vertexCount;
+            draw.firstMatrix = batchMatrices.length();
+            draw.matrixCount = 1;
+            draw.layout = packet.layout;
+            draw.uploadOffset = 0;
+            batchMatrices.append(packet.modelView);
+            mergedDraws.append(draw);
+        }
+        deferredVertices.append(vertices, packet.vertexCount);
+        if (batching) {
+            GLubyte slot = mergedDraws.last().matrixCount - 1;
+            for (int v = 0; v < packet.vertexCount; v++) {
+                matrixIndices.append(slot);
+            }
+        }
+    }
+
+    DrawState initial = captureDrawState();
+    DrawState current = initial;
+
+    gles3->glBindVertexArray(VAO);
+
+    // the modelviews and matrix indices of every batch are uploaded at once, the block binding of a draw
+    // spans the whole array so the upload is padded by one array
+    const GLsizeiptr modelViewArrayBytes = GLES1_SharedResources::modelViewArraySize * 16 * sizeof(GLfloat);
+    GLintptr modelViewOffset = 0;
+    GLintptr matrixIndexOffset = 0;
+    if (batched) {
+        batchModelViews.resize(batchMatrices.length() * 16 + GLES1_SharedResources::modelViewArraySize * 16);
+        for (int m = 0; m < batchMatrices.length(); m++) {
+            memcpy(batchModelViews.data() + m * 16, frameMatrices[batchMatrices[m]].constData(), 16 * sizeof(GLfloat));
+        }
+        modelViewOffset = streamUpload(uniformStream, GL_UNIFORM_BUFFER, batchModelViews.data(), batchModelViews.length() * sizeof(GLfloat), uniformAlignment);
+        matrixIndexOffset = streamUpload(matrixIndexStream, GL_ARRAY_BUFFER, matrixIndices.data(), matrixIndices.length());
+    }
+
+    // everything that is not deduplicated is uploaded at once, every draw packed with its own layout
+    bool indexable = vertexDeduplication;
+    GLintptr vertexOffset = 0;
+    if (!indexable) {
+        GLsizeiptr size = 0;
+        for (MergedDraw & draw : mergedDraws) {
+            draw.uploadOffset = size;
+            size += draw.vertexCount * draw.layout.stride();
+        }
+        char * destination = static_cast<char*>(streamMap(vertexStream, GL_ARRAY_BUFFER, size, 16, vertexOffset));
+        if (destination != nullptr) {
+            for (const MergedDraw & draw : mergedDraws) {
+                packVertices(reinterpret_cast<GLfloat*>(destination + draw.uploadOffset),
+                             deferredVertices.data() + draw.firstVertex, draw.vertexCount, draw.layout);
+            }
+            gles3->glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        stats.vertexBytesUploaded += size;
+    }
+
+    const GLES1_Program * drawProgram = nullptr;
+    int projection = -1;
+    int modelView = -1;
+    bool normalSet = false;
+    QVector3D normal;
+    for (const MergedDraw & draw : mergedDraws) {
+        const DrawPacket & packet = drawQueue[draw.packet];
+        bool matrixBatch = draw.matrixCount > 1;
+        const GLES1_Program * next = matrixBatch ? batchProgram : program;
+        if (next != drawProgram) {
+            // uniforms are per program
+            drawProgram = next;
+            drawProgram->shader->bind();
+            projection = -1;
+            modelView = -1;
+            normalSet = false;
+            if (matrixBatch) {
+                gles2->glEnableVertexAttribArray(2);
+            } else {
+                gles2->glDisableVertexAttribArray(2);
+            }
+            stats.stateChanges++;
+        }
+        QOpenGLShaderProgram * shader = drawProgram->shader;
+        applyDrawState(packet.state, current);
+        if (packet.projection != projection) {
+            projection = packet.projection;
+            shader->setUniformValue(drawProgram->projectionUniform, frameMatrices[projection]);
+            stats.stateChanges++;
+        }
+        if (matrixBatch) {
+            gles3->glBindBufferRange(GL_UNIFORM_BUFFER, GLES1_SharedResources::modelViewArrayBinding, uniformStream.buffer,
+                                     modelViewOffset + draw.firstMatrix * 16 * sizeof(GLfloat), modelViewArrayBytes);
+            gles2->glBindBuffer(GL_ARRAY_BUFFER, matrixIndexStream.buffer);
+            gles3->glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, 0, (void*)(matrixIndexOffset + draw.firstVertex));
+            gles2->glBindBuffer(GL_ARRAY_BUFFER, vertexStream.buffer);
+            stats.matrixBatches++;
+        } else if (packet.modelView != modelView) {
+            modelView = packet.modelView;
+            shader->setUniformValue(drawProgram->modelViewUniform, frameMatrices[modelView]);
+            stats.stateChanges++;
+        }
+        if (!normalSet || packet.normal != normal) {
+            normalSet = true;
+            normal = packet.normal;
+            shader->setUniformValue(drawProgram->normalUniform, normal);
+        }
+
+        if (indexable) {
+            drawVertices(packet.mode, deferredVertices.data() + draw.firstVertex, draw.vertexCount, draw.layout);
+        } else {
+            stats.verticesSubmitted += draw.vertexCount;
+            stats.verticesUploaded += draw.vertexCount;
+            drawUploaded(packet.mode, vertexOffset + draw.uploadOffset, draw.vertexCount, draw.layout);
+        }
+    }
+
+    gles2->glDisableVertexAttribArray(2);
+    gles3->glBindVertexArray(0);
+    drawProgram->shader->release();
+    applyDrawState(initial, current);
+
+    drawQueue.clear();
+    frameMatrices.clear();
+    staging.reset();
+    deferredVertices.reset();
 }
 
 QMatrix4x4 &GLES1_Wrapper::getCurrentMatrix() {
@@ -154,64 +627,634 @@ QMatrix4x4 GLES1_Wrapper::toMatrix(const GLdouble *m) {
     };
 }
 
-GLES1_Wrapper::GLES1_Wrapper(QOpenGLContext * context) : context(context) {
-    gles2 = context->functions();
-    gles3 = context->extraFunctions();
+GLES1_Matrix4d GLES1_Wrapper::toMatrix4d(const GLfloat *m) {
+    GLdouble values[16];
+    for (int i = 0; i < 16; i++) {
+        values[i] = m[i];
+    }
+    return GLES1_Matrix4d(values);
+}
+
+GLES1_Matrix4d GLES1_Wrapper::toMatrix4d(const GLdouble *m) {
+    return GLES1_Matrix4d(m);
+}
+
+bool GLES1_Wrapper::isDoubleModelView() {
+    return doublePrecision && matrixMode == GL_MODELVIEW;
+}
+
+void GLES1_Wrapper::syncModelView() {
+    GLES1_Matrix4d relative = stack_GL_MODELVIEW_MATRIX_DOUBLE.last();
+    relative.translate(cameraOrigin[0], cameraOrigin[1], cameraOrigin[2]);
+    stack_GL_MODELVIEW_MATRIX.last() = relative.toMatrix4x4();
+}
+
+// the vertex relative to the camera origin is v - origin * w, subtracted in double before narrowing
+void GLES1_Wrapper::stageRelative(GLdouble x, GLdouble y, GLdouble z, GLdouble w) {
+    GLfloat v[4];
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128d scale = _mm_set1_pd(w);
+    __m128d xy = _mm_sub_pd(_mm_set_pd(y, x), _mm_mul_pd(_mm_loadu_pd(cameraOrigin), scale));
+    __m128d zw = _mm_sub_pd(_mm_set_pd(w, z), _mm_mul_pd(_mm_set_pd(0, cameraOrigin[2]), scale));
+    _mm_storeu_ps(v, _mm_movelh_ps(_mm_cvtpd_ps(xy), _mm_cvtpd_ps(zw)));
+#else
+    v[0] = static_cast<float>(x - cameraOrigin[0] * w);
+    v[1] = static_cast<float>(y - cameraOrigin[1] * w);
+    v[2] = static_cast<float>(z - cameraOrigin[2] * w);
+    v[3] = static_cast<float>(w);
+#endif
+    staging.append(v[0], v[1], v[2], v[3], color_red, color_green, color_blue, color_alpha);
+}
+
+void GLES1_Wrapper::initializeState() {
     glMatrixMode(GL_MODELVIEW_MATRIX);
     stack_GL_PROJECTION_MATRIX.push(QMatrix4x4());
     stack_GL_MODELVIEW_MATRIX.push(QMatrix4x4());
     stack_GL_TEXTURE_MATRIX.push(QMatrix4x4());
     stack_GL_COLOR_MATRIX.push(QMatrix4x4());
     currentNormal = {0, 0, 1};
+    frameClock.start();
+}
 
-    if (!shader.isLinked()) {
-        QByteArray v = vertex_shader;
-        QByteArray f = fragment_shader;
-
-        // Any number representing a version of the language a compiler does not support
-        // will cause an error to be generated.
+GLES1_Wrapper::GLES1_Wrapper(QOpenGLContext * context) : context(context), pixelTransfer(context), attribs(context) {
+    gles2 = context->functions();
+    gles3 = context->extraFunctions();
+    initializeState();
 
-        if (context->isOpenGLES()) {
-            // android supports OpenGL ES 3.0 since android 4.3 (kitkat)
+    resources = GLES1_SharedResources::acquire(context);
+    program = resources->program(context, GLES1_SharedResources::DefaultVariant);
 
-            // android supports OpenGL ES 3.1 since android 5.0 (lollipop)
-            //  New functionality in OpenGL ES 3.1 includes:
-            //   Compute shaders
-            //   Independent vertex and fragment shaders
-            //   Indirect draw commands
+    vertexStream = resources->takeStreamBuffer(gles2);
+    indexStream = resources->takeStreamBuffer(gles2);
+    matrixIndexStream = resources->takeStreamBuffer(gles2);
+    uniformStream = resources->takeStreamBuffer(gles2);
+    gles2->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
 
-            // android supports OpenGL ES 3.2 since android 6.0 (marshmellow), possibly 7.0 (naugat)
+    gles3->glGenVertexArrays(1, &VAO);
+    GLES1_MemoryAccounting::allocate(GLES1_MemoryAccounting::VertexArrays, 0, 1);
+    gles3->glBindVertexArray(VAO);
+    gles2->glEnableVertexAttribArray(0);
+    gles2->glEnableVertexAttribArray(1);
+    gles3->glBindVertexArray(0);
+}
 
-            // OpenGL ES 3.0 (#version 300 es)
-            // OpenGL ES 3.1 (#version 310 es)
-            // OpenGL ES 3.2 (#version 320 es)
+GLES1_Wrapper::GLES1_Wrapper(GLES1_SoftwareRasterizer * rasterizer)
+    : context(nullptr), gles2(nullptr), gles3(nullptr), resources(nullptr), program(nullptr),
+      VAO(0), uniformAlignment(16), pixelTransfer(nullptr), attribs(rasterizer), software(rasterizer) {
+    initializeState();
+}
 
-            v.prepend(QByteArrayLiteral("#version 300 es\n"));
-            f.prepend(QByteArrayLiteral("#version 300 es\n"));
-        } else {
-            // OpenGL 3.3 (GLSL #version 330)
-            v.prepend(QByteArrayLiteral("#version 330\n"));
-            f.prepend(QByteArrayLiteral("#version 330\n"));
+GLES1_Wrapper::~GLES1_Wrapper()
+{
+    if (software != nullptr) return;
+    for (FrameInFlight & frame : framesInFlight) {
+        gles3->glDeleteSync(frame.fence);
+        // the gpu may still read them, whoever takes them next must orphan first
+        for (GLES1_StreamBuffer & stream : frame.streams) {
+            stream.offset = stream.capacity;
         }
-        if (!shader.addShaderFromSourceCode(QOpenGLShader::Vertex, v)) {
-            qFatal("OPENGL SHADER VERTEX SHADER COMPILATION FAILED");
+        recycledFrames.append(frame);
+    }
+    for (const FrameInFlight & frame : recycledFrames) {
+        for (const GLES1_StreamBuffer & stream : frame.streams) {
+            resources->returnStreamBuffer(stream);
         }
-        if (!shader.addShaderFromSourceCode(QOpenGLShader::Fragment, f)) {
-            qFatal("OPENGL SHADER FRAGMENT SHADER COMPILATION FAILED");
+    }
+    gles3->glDeleteVertexArrays(1, &VAO);
+    GLES1_MemoryAccounting::release(GLES1_MemoryAccounting::VertexArrays, 0, 1);
+    resources->returnStreamBuffer(vertexStream);
+    resources->returnStreamBuffer(indexStream);
+    resources->returnStreamBuffer(matrixIndexStream);
+    resources->returnStreamBuffer(uniformStream);
+    resources->release();
+}
+
+void GLES1_Wrapper::warmUpShaders(QOpenGLContext *shareContext)
+{
+    GLES1_SharedResources::warmUp(shareContext);
+}
+
+GLintptr GLES1_Wrapper::streamUpload(GLES1_StreamBuffer &stream, GLenum target, const void *data, GLsizeiptr size, GLsizeiptr alignment)
+{
+    GLintptr offset;
+    void * destination = streamMap(stream, target, size, alignment, offset);
+    if (destination != nullptr) {
+        memcpy(destination, data, size);
+        gles3->glUnmapBuffer(target);
+    }
+    return offset;
+}
+
+void *GLES1_Wrapper::streamMap(GLES1_StreamBuffer &stream, GLenum target, GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset)
+{
+    gles2->glBindBuffer(target, stream.buffer);
+    offset = (stream.offset + alignment - 1) / alignment * alignment;
+    if (offset + size > stream.capacity) {
+        // orphan the storage, the driver keeps the previous one alive until draws using it are done,
+        // within a paced frame it grows so that the next frame written into this set fits
+        GLsizeiptr capacity = qMax(inFrame ? stream.capacity * 2 : stream.capacity, minimumStreamCapacity);
+        while (capacity < size) {
+            capacity *= 2;
+        }
+        gles2->glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+        GLES1_MemoryAccounting::resize(GLES1_MemoryAccounting::Buffers, stream.capacity, capacity);
+        stream.capacity = capacity;
+        offset = 0;
+    }
+    stream.offset = offset + size;
+    if (size == 0) return nullptr;
+    // nothing in flight can overlap the range written, so the driver does not need to synchronize
+    return gles3->glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void GLES1_Wrapper::glRasterPos2i(GLint x, GLint y)
+{
+    glRasterPos4f(x, y, 0, 1);
+}
+
+void GLES1_Wrapper::glRasterPos2f(GLfloat x, GLfloat y)
+{
+    glRasterPos4f(x, y, 0, 1);
+}
+
+void GLES1_Wrapper::glRasterPos2d(GLdouble x, GLdouble y)
+{
+    glRasterPos4d(x, y, 0, 1);
+}
+
+void GLES1_Wrapper::glRasterPos3f(GLfloat x, GLfloat y, GLfloat z)
+{
+    glRasterPos4f(x, y, z, 1);
+}
+
+void GLES1_Wrapper::glRasterPos3d(GLdouble x, GLdouble y, GLdouble z)
+{
+    glRasterPos4d(x, y, z, 1);
+}
+
+void GLES1_Wrapper::glRasterPos4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+    glRasterPos4d(x, y, z, w);
+}
+
+void GLES1_Wrapper::glRasterPos4d(GLdouble x, GLdouble y, GLdouble z, GLdouble w)
+{
+    // every variant ends up here
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::RasterPos4d, x, y, z, w);
+    if (doublePrecision) {
+        x -= cameraOrigin[0] * w;
+        y -= cameraOrigin[1] * w;
+        z -= cameraOrigin[2] * w;
+    }
+    QVector4D clip = stack_GL_PROJECTION_MATRIX.last() * stack_GL_MODELVIEW_MATRIX.last() * QVector4D(x, y, z, w);
+    rasterValid = clip.w() > 0
+            && qAbs(clip.x()) <= clip.w()
+            && qAbs(clip.y()) <= clip.w()
+            && qAbs(clip.z()) <= clip.w();
+    if (!rasterValid) return;
+
+    GLint viewport[4];
+    if (software != nullptr) {
+        memcpy(viewport, software->state().viewport, sizeof(viewport));
+    } else {
+        gles2->glGetIntegerv(GL_VIEWPORT, viewport);
+    }
+    rasterPosition = QVector3D(
+                viewport[0] + (clip.x() / clip.w() + 1) * viewport[2] / 2,
+                viewport[1] + (clip.y() / clip.w() + 1) * viewport[3] / 2,
+                clip.z() / clip.w());
+}
+
+void GLES1_Wrapper::glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, const void *data)
+{
+    if (begin || software != nullptr || !rasterValid || width <= 0 || height <= 0) return;
+    if (GLES1_PixelTransfer::textureFormat(format, type) == 0) {
+        qWarning() << "GLES1_Wrapper: glDrawPixels does not support format" << format << "of type" << type;
+        return;
+    }
+    const GLES1_Program * pixels = resources->program(context, GLES1_SharedResources::PixelsVariant);
+    if (pixels == nullptr) return;
+
+    // the pixels must land after the blocks submitted before them
+    drawDeferred();
+
+    GLint activeTexture;
+    GLint previousTexture;
+    gles2->glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+    gles2->glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+    pixelTransfer.upload(width, height, format, type, data);
+
+    // a quad covering the pixels in normalized device coordinates, at the depth of the raster position
+    GLint viewport[4];
+    gles2->glGetIntegerv(GL_VIEWPORT, viewport);
+    GLfloat left = (rasterPosition.x() - viewport[0]) / viewport[2] * 2 - 1;
+    GLfloat right = (rasterPosition.x() + width - viewport[0]) / viewport[2] * 2 - 1;
+    GLfloat bottom = (rasterPosition.y() - viewport[1]) / viewport[3] * 2 - 1;
+    GLfloat top = (rasterPosition.y() + height - viewport[1]) / viewport[3] * 2 - 1;
+    GLfloat depth = rasterPosition.z();
+    const GLES1_Vertex quad[] = {
+        {left, bottom, depth, 1, 0, 0, 0, 0},
+        {right, bottom, depth, 1, 0, 0, 0, 0},
+        {left, top, depth, 1, 0, 0, 0, 0},
+        {right, top, depth, 1, 0, 0, 0, 0},
+    };
+
+    QOpenGLShaderProgram * shader = pixels->shader;
+    shader->bind();
+    shader->setUniformValue(pixels->pixelsUniform, activeTexture - GL_TEXTURE0);
+    shader->setUniformValue(pixels->originUniform, rasterPosition.x(), rasterPosition.y());
+    gles3->glBindVertexArray(VAO);
+
+    stats.verticesSubmitted += 4;
+    stats.verticesUploaded += 4;
+    drawUploaded(GL_TRIANGLE_STRIP, uploadVertices(quad, 4, fullLayout), 4, fullLayout);
+
+    gles3->glBindVertexArray(0);
+    shader->release();
+    gles2->glBindTexture(GL_TEXTURE_2D, previousTexture);
+}
+
+quint32 GLES1_Wrapper::readPixelsAsync(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+    if (begin || software != nullptr) return 0;
+    // the read must see the blocks submitted before it
+    drawDeferred();
+    quint32 handle = pixelTransfer.startRead(x, y, width, height, format, type);
+    if (handle == 0) {
+        qWarning() << "GLES1_Wrapper: readPixelsAsync does not support format" << format << "of type" << type;
+    }
+    return handle;
+}
+
+bool GLES1_Wrapper::isReadPixelsComplete(quint32 handle)
+{
+    return pixelTransfer.isReadComplete(handle);
+}
+
+GLsizeiptr GLES1_Wrapper::readPixelsSize(quint32 handle)
+{
+    return pixelTransfer.readSize(handle);
+}
+
+bool GLES1_Wrapper::takeReadPixels(quint32 handle, void *data)
+{
+    return pixelTransfer.takeRead(handle, data);
+}
+
+void GLES1_Wrapper::cancelReadPixels(quint32 handle)
+{
+    pixelTransfer.cancelRead(handle);
+}
+
+GLint GLES1_Wrapper::glRenderMode(GLenum mode)
+{
+    if (begin) return 0;
+    if (mode != GL_RENDER && mode != GL_SELECT) {
+        qWarning() << "GLES1_Wrapper: render mode" << mode << "is not supported";
+        return 0;
+    }
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::RenderMode, mode);
+
+    GLint result = 0;
+    if (renderMode == GL_SELECT) {
+        result = selection.end();
+    }
+    if (mode == GL_SELECT) {
+        // blocks deferred before selecting are drawn, not selected
+        drawDeferred();
+        selection.begin();
+    }
+    renderMode = mode;
+    return result;
+}
+
+void GLES1_Wrapper::glSelectBuffer(GLsizei size, GLuint *buffer)
+{
+    if (renderMode == GL_SELECT) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SelectBuffer, GLenum(size));
+    selection.setBuffer(buffer, size);
+}
+
+void GLES1_Wrapper::glInitNames()
+{
+    if (renderMode != GL_SELECT) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::InitNames);
+    selection.initNames();
+}
+
+void GLES1_Wrapper::glPushName(GLuint name)
+{
+    if (renderMode != GL_SELECT) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PushName, GLenum(name));
+    selection.pushName(name);
+}
+
+void GLES1_Wrapper::glPopName()
+{
+    if (renderMode != GL_SELECT) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PopName);
+    selection.popName();
+}
+
+void GLES1_Wrapper::glLoadName(GLuint name)
+{
+    if (renderMode != GL_SELECT) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadName, GLenum(name));
+    selection.loadName(name);
+}
+
+void GLES1_Wrapper::gluPickMatrix(GLdouble x, GLdouble y, GLdouble width, GLdouble height, const GLint *viewport)
+{
+    if (width <= 0 || height <= 0) return;
+    glTranslated((viewport[2] - 2 * (x - viewport[0])) / width, (viewport[3] - 2 * (y - viewport[1])) / height, 0);
+    glScaled(viewport[2] / width, viewport[3] / height, 1);
+}
+
+void GLES1_Wrapper::glPushAttrib(GLbitfield mask)
+{
+    if (begin) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PushAttrib, GLenum(mask));
+    GLES1_AttribStack::Current current = {
+        {color_red, color_green, color_blue, color_alpha},
+        {currentNormal.x(), currentNormal.y(), currentNormal.z()},
+        matrixMode
+    };
+    attribs.push(mask, current);
+}
+
+void GLES1_Wrapper::glPopAttrib()
+{
+    if (begin) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PopAttrib);
+    GLES1_AttribStack::Current current;
+    GLbitfield mask = attribs.pop(current);
+    if (mask & GL_CURRENT_BIT) {
+        if (trace.isRecording()) trace.forgetCurrent();
+        color_red = current.color[0];
+        color_green = current.color[1];
+        color_blue = current.color[2];
+        color_alpha = current.color[3];
+        currentNormal = {current.normal[0], current.normal[1], current.normal[2]};
+    }
+    if (mask & GL_TRANSFORM_BIT) {
+        matrixMode = current.matrixMode;
+    }
+}
+
+void GLES1_Wrapper::invalidateState()
+{
+    attribs.invalidate();
+}
+
+void GLES1_Wrapper::glClear(GLbitfield mask)
+{
+    if (begin) return;
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Clear, GLenum(mask));
+    if (software != nullptr) {
+        software->clear(mask);
+    } else {
+        // blocks deferred before the clear must not draw over it
+        drawDeferred();
+        gles2->glClear(mask);
+    }
+}
+
+void GLES1_Wrapper::glEnable(GLenum capability)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Enable, capability);
+    attribs.setEnabled(capability, true);
+}
+
+void GLES1_Wrapper::glDisable(GLenum capability)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Disable, capability);
+    attribs.setEnabled(capability, false);
+}
+
+void GLES1_Wrapper::glBlendFunc(GLenum source, GLenum destination)
+{
+    if (trace.isRecording()) trace.record<quint32>(GLES1_TraceOp::BlendFuncSeparate, source, destination, source, destination);
+    attribs.blendFuncSeparate(source, destination, source, destination);
+}
+
+void GLES1_Wrapper::glBlendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+    if (trace.isRecording()) trace.record<quint32>(GLES1_TraceOp::BlendFuncSeparate, sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+    attribs.blendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+}
+
+void GLES1_Wrapper::glBlendEquation(GLenum mode)
+{
+    if (trace.isRecording()) {
+        const quint32 modes[] = {mode, mode};
+        trace.record(GLES1_TraceOp::BlendEquationSeparate, modes, 2);
+    }
+    attribs.blendEquationSeparate(mode, mode);
+}
+
+void GLES1_Wrapper::glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+{
+    if (trace.isRecording()) {
+        const quint32 modes[] = {modeRGB, modeAlpha};
+        trace.record(GLES1_TraceOp::BlendEquationSeparate, modes, 2);
+    }
+    attribs.blendEquationSeparate(modeRGB, modeAlpha);
+}
+
+void GLES1_Wrapper::glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    if (trace.isRecording()) trace.record<quint32>(GLES1_TraceOp::ColorMask, red, green, blue, alpha);
+    attribs.colorMask(red, green, blue, alpha);
+}
+
+void GLES1_Wrapper::glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::ClearColor, red, green, blue, alpha);
+    attribs.clearColor(red, green, blue, alpha);
+}
+
+void GLES1_Wrapper::glDepthFunc(GLenum func)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::DepthFunc, func);
+    attribs.depthFunc(func);
+}
+
+void GLES1_Wrapper::glDepthMask(GLboolean flag)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::DepthMask, GLenum(flag));
+    attribs.depthMask(flag);
+}
+
+void GLES1_Wrapper::glClearDepth(GLdouble depth)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::ClearDepth, &depth, 1);
+    attribs.clearDepth(depth);
+}
+
+void GLES1_Wrapper::glDepthRange(GLdouble nearVal, GLdouble farVal)
+{
+    if (trace.isRecording()) {
+        const GLdouble range[] = {nearVal, farVal};
+        trace.record(GLES1_TraceOp::DepthRange, range, 2);
+    }
+    attribs.depthRange(nearVal, farVal);
+}
+
+void GLES1_Wrapper::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (trace.isRecording()) trace.record<quint32>(GLES1_TraceOp::Viewport, x, y, width, height);
+    attribs.setViewport(x, y, width, height);
+}
+
+void GLES1_Wrapper::glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (trace.isRecording()) trace.record<quint32>(GLES1_TraceOp::Scissor, x, y, width, height);
+    attribs.scissor(x, y, width, height);
+}
+
+void GLES1_Wrapper::glActiveTexture(GLenum unit)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::ActiveTexture, unit);
+    attribs.activeTexture(unit);
+}
+
+void GLES1_Wrapper::glBindTexture(GLenum target, GLuint texture)
+{
+    if (trace.isRecording()) {
+        const quint32 binding[] = {target, texture};
+        trace.record(GLES1_TraceOp::BindTexture, binding, 2);
+    }
+    attribs.bindTexture(target, texture);
+}
+
+void GLES1_Wrapper::glDeleteTextures(GLsizei count, const GLuint *textures)
+{
+    // deferred blocks may still sample them
+    drawDeferred();
+    attribs.deleteTextures(count, textures);
+}
+
+bool GLES1_Wrapper::startCapture(const QString &path)
+{
+    return trace.open(path);
+}
+
+void GLES1_Wrapper::stopCapture()
+{
+    trace.close();
+}
+
+bool GLES1_Wrapper::isCapturing()
+{
+    return trace.isRecording();
+}
+
+void GLES1_Wrapper::setDeferredSubmissionEnabled(bool enabled)
+{
+    if (!enabled) {
+        flush();
+    }
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetDeferredSubmission, GLenum(enabled));
+    deferredSubmission = enabled;
+}
+
+bool GLES1_Wrapper::isDeferredSubmissionEnabled()
+{
+    return deferredSubmission;
+}
+
+void GLES1_Wrapper::setVertexDeduplicationEnabled(bool enabled)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetVertexDeduplication, GLenum(enabled));
+    vertexDeduplication = enabled;
+}
+
+bool GLES1_Wrapper::isVertexDeduplicationEnabled()
+{
+    return vertexDeduplication;
+}
+
+void GLES1_Wrapper::setMatrixBatchingEnabled(bool enabled)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetMatrixBatching, GLenum(enabled));
+    matrixBatching = enabled;
+}
+
+bool GLES1_Wrapper::isMatrixBatchingEnabled()
+{
+    return matrixBatching;
+}
+
+void GLES1_Wrapper::setDoublePrecisionEnabled(bool enabled)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetDoublePrecision, GLenum(enabled));
+    if (enabled == doublePrecision) return;
+    doublePrecision = enabled;
+
+    if (enabled) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.clear();
+        for (const QMatrix4x4 & matrix : stack_GL_MODELVIEW_MATRIX) {
+            stack_GL_MODELVIEW_MATRIX_DOUBLE.push(GLES1_Matrix4d(matrix));
         }
-        if (!shader.link()) {
-            qFatal("OPENGL SHADER LINK FAILED");
+        syncModelView();
+    } else {
+        // back to absolute matrices
+        for (int i = 0; i < stack_GL_MODELVIEW_MATRIX.length(); i++) {
+            stack_GL_MODELVIEW_MATRIX[i] = stack_GL_MODELVIEW_MATRIX_DOUBLE[i].toMatrix4x4();
         }
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.clear();
     }
+}
+
+bool GLES1_Wrapper::isDoublePrecisionEnabled()
+{
+    return doublePrecision;
+}
+
+void GLES1_Wrapper::setCameraOrigin(GLdouble x, GLdouble y, GLdouble z)
+{
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::SetCameraOrigin, x, y, z);
+    cameraOrigin[0] = x;
+    cameraOrigin[1] = y;
+    cameraOrigin[2] = z;
+    if (doublePrecision) syncModelView();
+}
 
-    shader.bind();
-    projectionUniform = shader.uniformLocation("projection");
-    modelViewUniform = shader.uniformLocation("modelView");
-    normalUniform = shader.uniformLocation("normal");
+double GLES1_Wrapper::Stats::vertexCompressionRatio() const
+{
+    if (verticesUploaded == 0) return 1;
+    return static_cast<double>(verticesSubmitted) / static_cast<double>(verticesUploaded);
+}
+
+const GLES1_Wrapper::Stats &GLES1_Wrapper::getStats()
+{
+    stats.stagingAllocations = staging.allocationCount();
+    stats.stagingTrims = staging.trimCount();
+    stats.stagingCapacityBytes = staging.capacityBytes();
+    stats.stateCallsSkipped = attribs.skippedCount();
+    return stats;
+}
+
+void GLES1_Wrapper::resetStats()
+{
+    stats = Stats();
+    staging.resetCounters();
+    attribs.resetCounters();
 }
 
 void GLES1_Wrapper::glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble nearVal, GLdouble farVal)
 {
+    if (trace.isRecording()) {
+        const GLdouble values[] = {left, right, bottom, top, nearVal, farVal};
+        trace.record(GLES1_TraceOp::Ortho, values, 6);
+    }
+    if (isDoubleModelView()) {
+        QMatrix4x4 matrix;
+        matrix.ortho(left, right, bottom, top, nearVal, farVal);
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() *= GLES1_Matrix4d(matrix);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().ortho(left, right, bottom, top, nearVal, farVal);
 }
 
@@ -222,15 +1265,35 @@ void GLES1_Wrapper::gluOrtho2D(GLdouble left, GLdouble right, GLdouble bottom, G
 
 void GLES1_Wrapper::gluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFar)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Perspective, fovy, aspect, zNear, zFar);
+    if (isDoubleModelView()) {
+        QMatrix4x4 matrix;
+        matrix.perspective(fovy, aspect, zNear, zFar);
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() *= GLES1_Matrix4d(matrix);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().perspective(fovy, aspect, zNear, zFar);
 }
 
 void GLES1_Wrapper::glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble nearVal, GLdouble farVal)
 {
+    if (trace.isRecording()) {
+        const GLdouble values[] = {left, right, bottom, top, nearVal, farVal};
+        trace.record(GLES1_TraceOp::Frustum, values, 6);
+    }
+    if (isDoubleModelView()) {
+        QMatrix4x4 matrix;
+        matrix.frustum(left, right, bottom, top, nearVal, farVal);
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() *= GLES1_Matrix4d(matrix);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().frustum(left, right, bottom, top, nearVal, farVal);
 }
 
 void GLES1_Wrapper::glMatrixMode(GLenum mode) {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::MatrixMode, mode);
     matrixMode = mode;
 }
 
@@ -239,20 +1302,34 @@ GLenum GLES1_Wrapper::getMatrixMode() {
 }
 
 void GLES1_Wrapper::glLoadIdentity() {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadIdentity);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().setToIdentity();
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().setToIdentity();
 }
 
 void GLES1_Wrapper::glPushMatrix()
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PushMatrix);
     switch (matrixMode) {
     case GL_PROJECTION:
         stack_GL_PROJECTION_MATRIX.push(QMatrix4x4(stack_GL_PROJECTION_MATRIX.last()));
+        break;
     case GL_MODELVIEW:
         stack_GL_MODELVIEW_MATRIX.push(QMatrix4x4(stack_GL_MODELVIEW_MATRIX.last()));
+        if (doublePrecision) {
+            stack_GL_MODELVIEW_MATRIX_DOUBLE.push(stack_GL_MODELVIEW_MATRIX_DOUBLE.last());
+        }
+        break;
     case GL_TEXTURE:
         stack_GL_TEXTURE_MATRIX.push(QMatrix4x4(stack_GL_TEXTURE_MATRIX.last()));
+        break;
     case GL_COLOR:
         stack_GL_COLOR_MATRIX.push(QMatrix4x4(stack_GL_COLOR_MATRIX.last()));
+        break;
     default:
         qFatal("unknown matrix mode");
     }
@@ -260,23 +1337,33 @@ void GLES1_Wrapper::glPushMatrix()
 
 void GLES1_Wrapper::glPopMatrix()
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::PopMatrix);
     switch (matrixMode) {
     case GL_PROJECTION:
         if (stack_GL_PROJECTION_MATRIX.length() > 1) {
             stack_GL_PROJECTION_MATRIX.removeLast();
         }
+        break;
     case GL_MODELVIEW:
         if (stack_GL_MODELVIEW_MATRIX.length() > 1) {
             stack_GL_MODELVIEW_MATRIX.removeLast();
+            if (doublePrecision) {
+                // the matrix below may predate the current camera origin
+                stack_GL_MODELVIEW_MATRIX_DOUBLE.removeLast();
+                syncModelView();
+            }
         }
+        break;
     case GL_TEXTURE:
         if (stack_GL_TEXTURE_MATRIX.length() > 1) {
             stack_GL_TEXTURE_MATRIX.removeLast();
         }
+        break;
     case GL_COLOR:
         if (stack_GL_COLOR_MATRIX.length() > 1) {
             stack_GL_COLOR_MATRIX.removeLast();
         }
+        break;
     default:
         qFatal("unknown matrix mode");
     }
@@ -284,73 +1371,159 @@ void GLES1_Wrapper::glPopMatrix()
 
 void GLES1_Wrapper::glLoadMatrixd(const GLdouble *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadMatrixd, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() = toMatrix4d(m);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() = toMatrix(m);
 }
 
 void GLES1_Wrapper::glLoadMatrixf(const GLfloat *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadMatrixf, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() = toMatrix4d(m);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() = toMatrix(m);
 }
 
 void GLES1_Wrapper::glMultMatrixd(const GLdouble *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::MultMatrixd, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() *= toMatrix4d(m);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() *= toMatrix(m);
 }
 
 void GLES1_Wrapper::glMultMatrixf(const GLfloat *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::MultMatrixf, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() *= toMatrix4d(m);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() *= toMatrix(m);
 }
 
 void GLES1_Wrapper::glLoadTransposeMatrixd(const GLdouble *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadTransposeMatrixd, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() = toMatrix4d(m).transposed();
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() = toMatrix(m).transposed();
 }
 
 void GLES1_Wrapper::glLoadTransposeMatrixf(const GLfloat *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::LoadTransposeMatrixf, m, 16);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last() = toMatrix4d(m).transposed();
+        syncModelView();
+        return;
+    }
     getCurrentMatrix() = toMatrix(m).transposed();
 }
 
 void GLES1_Wrapper::glMultTransposeMatrixd(const GLdouble *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::MultTransposeMatrixd, m, 16);
+    if (isDoubleModelView()) {
+        GLES1_Matrix4d & current = stack_GL_MODELVIEW_MATRIX_DOUBLE.last();
+        current = (current * toMatrix4d(m)).transposed();
+        syncModelView();
+        return;
+    }
     auto & current = getCurrentMatrix();
     current = (current * toMatrix(m)).transposed();
 }
 
 void GLES1_Wrapper::glMultTransposeMatrixf(const GLfloat *m)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::MultTransposeMatrixf, m, 16);
+    if (isDoubleModelView()) {
+        GLES1_Matrix4d & current = stack_GL_MODELVIEW_MATRIX_DOUBLE.last();
+        current = (current * toMatrix4d(m)).transposed();
+        syncModelView();
+        return;
+    }
     auto & current = getCurrentMatrix();
     current = (current * toMatrix(m)).transposed();
 }
 
 void GLES1_Wrapper::glTranslated(GLdouble x, GLdouble y, GLdouble z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Translated, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().translate(x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().translate(x, y, z);
 }
 
 void GLES1_Wrapper::glTranslatef(GLfloat x, GLfloat y, GLfloat z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Translatef, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().translate(x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().translate(x, y, z);
 }
 
 void GLES1_Wrapper::glScaled(GLdouble x, GLdouble y, GLdouble z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Scaled, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().scale(x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().scale(x, y, z);
 }
 
 void GLES1_Wrapper::glScalef(GLfloat x, GLfloat y, GLfloat z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Scalef, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().scale(x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().scale(x, y, z);
 }
 
 void GLES1_Wrapper::glRotated(GLdouble angle, GLdouble x, GLdouble y, GLdouble z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Rotated, angle, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().rotate(angle, x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().rotate(angle, x, y, z);
 }
 
 void GLES1_Wrapper::glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
 {
+    if (trace.isRecording()) trace.record(GLES1_TraceOp::Rotatef, angle, x, y, z);
+    if (isDoubleModelView()) {
+        stack_GL_MODELVIEW_MATRIX_DOUBLE.last().rotate(angle, x, y, z);
+        syncModelView();
+        return;
+    }
     getCurrentMatrix().rotate(angle, x, y, z);
 }
 
@@ -419,14 +1592,28 @@ void GLES1_Wrapper::glVertex3i(GLint x, GLint y, GLint z)
 
 void GLES1_Wrapper::glVertex3f(GLfloat x, GLfloat y, GLfloat z)
 {
-    vertexData.append({x, y, z, 1, color_red, color_blue, color_green, color_alpha});
-    vertexCount++;
+    if (trace.isRecording()) {
+        trace.recordColor(color_red, color_green, color_blue, color_alpha);
+        trace.record(GLES1_TraceOp::Vertex3f, x, y, z);
+    }
+    if (doublePrecision) {
+        stageRelative(x, y, z, 1);
+        return;
+    }
+    staging.append(x, y, z, 1, color_red, color_green, color_blue, color_alpha);
 }
 
 void GLES1_Wrapper::glVertex3d(GLdouble x, GLdouble y, GLdouble z)
 {
-    vertexData.append({static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), 1, color_red, color_blue, color_green, color_alpha});
-    vertexCount++;
+    if (trace.isRecording()) {
+        trace.recordColor(color_red, color_green, color_blue, color_alpha);
+        trace.record(GLES1_TraceOp::Vertex3d, x, y, z);
+    }
+    if (doublePrecision) {
+        stageRelative(x, y, z, 1);
+        return;
+    }
+    staging.append(x, y, z, 1, color_red, color_green, color_blue, color_alpha);
 }
 
 void GLES1_Wrapper::glVertex4s(GLshort x, GLshort y, GLshort z, GLshort w)
@@ -447,14 +1634,28 @@ void GLES1_Wrapper::glVertex4i(GLint x, GLint y, GLint z, GLint w)
 
 void GLES1_Wrapper::glVertex4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w)
 {
-    vertexData.append({x, y, z, w, color_red, color_blue, color_green, color_alpha});
-    vertexCount++;
+    if (trace.isRecording()) {
+        trace.recordColor(color_red, color_green, color_blue, color_alpha);
+        trace.record(GLES1_TraceOp::Vertex4f, x, y, z, w);
+    }
+    if (doublePrecision) {
+        stageRelative(x, y, z, w);
+        return;
+    }
+    staging.append(x, y, z, w, color_red, color_green, color_blue, color_alpha);
 }
 
 void GLES1_Wrapper::glVertex4d(GLdouble x, GLdouble y, GLdouble z, GLdouble w)
 {
-    vertexData.append({static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), static_cast<float>(w), color_red, color_blue, color_green, color_alpha});
-    vertexCount++;
+    if (trace.isRecording()) {
+        trace.recordColor(color_red, color_green, color_blue, color_alpha);
+        trace.record(GLES1_TraceOp::Vertex4d, x, y, z, w);
+    }
+    if (doublePrecision) {
+        stageRelative(x, y, z, w);
+        return;
+    }
+    staging.append(x, y, z, w, color_red, color_green, color_blue, color_alpha);
 }
 
 void GLES1_Wrapper::glVertex2sv(const GLshort *v)
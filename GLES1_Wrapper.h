@@ -1,6 +1,7 @@
 #ifndef GLES1_WRAPPER_H
 #define GLES1_WRAPPER_H
 
+#include <QElapsedTimer>
 #include <QOpenGLContext>
 #include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
@@ -10,31 +11,88 @@
 
 #include "GLUTesselator/src/tess.h"
 
+#include "GLES1_AttribStack.h"
+#include "GLES1_IndexedMesh.h"
+#include "GLES1_Matrix4d.h"
+#include "GLES1_MemoryAccounting.h"
+#include "GLES1_PixelTransfer.h"
+#include "GLES1_Selection.h"
+#include "GLES1_SharedResources.h"
+#include "GLES1_SoftwareRasterizer.h"
+#include "GLES1_Trace.h"
+#include "GLES1_VertexArena.h"
+
 class GLES1_Wrapper
 {
-    static const char * vertex_shader;
-    static const char * fragment_shader;
+    Q_DISABLE_COPY(GLES1_Wrapper)
+
     QOpenGLContext * context;
     QOpenGLFunctions *gles2;
     QOpenGLExtraFunctions *gles3;
-    QOpenGLShaderProgram shader;
+    GLES1_SharedResources * resources;
+    const GLES1_Program * program;
+
+    // vertex array objects are not shared between contexts
+    GLuint VAO;
+    GLES1_StreamBuffer vertexStream;
+    GLES1_StreamBuffer indexStream;
+    GLES1_StreamBuffer matrixIndexStream;
+    GLES1_StreamBuffer uniformStream;
+
+    // the smallest storage a stream buffer is created with
+    static const GLsizeiptr minimumStreamCapacity = 256 * 1024;
+
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLint uniformAlignment;
+
+    // the returned offset is a multiple of alignment
+    GLintptr streamUpload(GLES1_StreamBuffer & stream, GLenum target, const void * data, GLsizeiptr size, GLsizeiptr alignment = 16);
+    // maps size bytes at such an offset for writing, unmap target before drawing, nullptr if size is 0
+    void * streamMap(GLES1_StreamBuffer & stream, GLenum target, GLsizeiptr size, GLsizeiptr alignment, GLintptr & offset);
+
+    // vertexStream, indexStream, matrixIndexStream and uniformStream of a frame ended with endFrame
+    struct FrameInFlight {
+        GLsync fence = nullptr;
+        // frameClock at endFrame
+        qint64 submitted = 0;
+        GLES1_StreamBuffer streams[4];
+    };
+
+    bool inFrame = false;
+    int maxFramesInFlight = 2;
+    QElapsedTimer frameClock;
+    // oldest first
+    QList<FrameInFlight> framesInFlight;
+    QList<FrameInFlight> recycledFrames;
+
+    // a wait times out this many times before the frame's buffers are orphaned
+    static const GLuint64 frameWaitTimeout = 100000000;
+    static const int frameWaitRetries = 10;
+
+    void exchangeStreams(GLES1_StreamBuffer * streams);
+    // waits for the oldest frames while more than keep are in flight
+    void retireFrames(int keep);
 
     QStack<QMatrix4x4> stack_GL_PROJECTION_MATRIX;
     QStack<QMatrix4x4> stack_GL_MODELVIEW_MATRIX;
     QStack<QMatrix4x4> stack_GL_TEXTURE_MATRIX;
     QStack<QMatrix4x4> stack_GL_COLOR_MATRIX;
 
-    int projectionUniform;
-    int modelViewUniform;
-    int normalUniform;
-
     GLenum matrixMode;
 
     QMatrix4x4 & getCurrentMatrix();
+
+    // in double precision mode the float modelview stack is translated by cameraOrigin
+    bool doublePrecision = false;
+    QStack<GLES1_Matrix4d> stack_GL_MODELVIEW_MATRIX_DOUBLE;
+    GLdouble cameraOrigin[3] = {0, 0, 0};
+
+    bool isDoubleModelView();
+    void syncModelView();
+    void stageRelative(GLdouble x, GLdouble y, GLdouble z, GLdouble w);
     QVector3D currentNormal;
 
-    QList<float> vertexData;
-    GLsizei vertexCount;
+    GLES1_VertexArena staging;
 
     GLfloat vertex_x;
     GLfloat vertex_y;
@@ -55,18 +113,277 @@ class GLES1_Wrapper
 
 
     GLenum primitiveMode;
-    bool begin;
+    bool begin = false;
+    int blockStart = 0;
+
+    bool vertexDeduplication = false;
+    GLES1_IndexedMesh indexedMesh;
+
+    // in window coordinates, with the depth in normalized device coordinates
+    QVector3D rasterPosition = {0, 0, -1};
+    bool rasterValid = true;
+    GLES1_PixelTransfer pixelTransfer;
+
+    GLES1_AttribStack attribs;
+
+    // draws in place of GL when set, see GLES1_SoftwareRasterizer
+    GLES1_SoftwareRasterizer * software = nullptr;
+    void initializeState();
+
+    GLenum renderMode = GL_RENDER;
+    GLES1_Selection selection;
 
     QMatrix4x4 toMatrix(const GLfloat * m);
     QMatrix4x4 toMatrix(const GLdouble * m);
+    // the same element order as toMatrix
+    GLES1_Matrix4d toMatrix4d(const GLfloat * m);
+    GLES1_Matrix4d toMatrix4d(const GLdouble * m);
+
+    // the attributes a run of staged vertices is uploaded with, a shared color becomes a constant attribute
+    struct VertexLayout {
+        bool constantColor;
+        bool affine;
+        GLfloat color[4];
+
+        inline GLsizei stride() const {
+            return ((affine ? 3 : 4) + (constantColor ? 0 : 4)) * sizeof(GLfloat);
+        }
+
+        // the layout of both runs drawn together
+        inline void merge(const VertexLayout & other) {
+            affine = affine && other.affine;
+            constantColor = constantColor && other.constantColor
+                    && color[0] == other.color[0] && color[1] == other.color[1]
+                    && color[2] == other.color[2] && color[3] == other.color[3];
+        }
+    };
+
+    static const VertexLayout fullLayout;
+
+    // of the staged vertices from first to the end
+    VertexLayout stagedLayout(int first);
+    static void packVertices(GLfloat * destination, const GLES1_Vertex * vertices, GLsizei vertexCount, const VertexLayout & layout);
+    GLintptr uploadVertices(const GLES1_Vertex * vertices, GLsizei vertexCount, const VertexLayout & layout);
+
+    void setVertexAttributes(GLintptr vertexOffset, const VertexLayout & layout);
+    void drawVertices(GLenum mode, const GLES1_Vertex * vertices, GLsizei vertexCount, const VertexLayout & layout);
+    void drawUploaded(GLenum mode, GLintptr vertexOffset, GLsizei vertexCount, const VertexLayout & layout);
+
+    // the GL state a deferred draw depends on, captured at glEnd
+    struct DrawState {
+        GLuint texture;
+        GLES1_AttribStack::Snapshot raster;
+
+        bool operator==(const DrawState & other) const {
+            return texture == other.texture && raster == other.raster;
+        }
+    };
+
+    // a glBegin/glEnd block recorded in deferred mode, its vertices stay in staging until flush
+    struct DrawPacket {
+        GLenum mode;
+        int firstVertex;
+        int vertexCount;
+        int variant;
+        DrawState state;
+        // indices into frameMatrices
+        int projection;
+        int modelView;
+        QVector3D normal;
+        VertexLayout layout;
+    };
+
+    // consecutive packets drawn with a single call, laid out contiguously in deferredVertices
+    struct MergedDraw {
+        int packet;
+        int firstVertex;
+        GLsizei vertexCount;
+        // the modelviews of a matrix batch, a range of batchMatrices
+        int firstMatrix;
+        int matrixCount;
+        // the layout shared by its packets, and where its packed vertices start in the upload
+        VertexLayout layout;
+        GLintptr uploadOffset;
+    };
+
+    GLES1_TraceWriter trace;
+
+    bool deferredSubmission = false;
+    QList<DrawPacket> drawQueue;
+    QList<QMatrix4x4> frameMatrices;
+    QList<int> drawOrder;
+    QList<MergedDraw> mergedDraws;
+    GLES1_VertexArena deferredVertices;
+
+    bool matrixBatching = false;
+    // indices into frameMatrices uploaded to the modelview uniform block, and the slot of every deferred vertex
+    QList<int> batchMatrices;
+    QList<GLubyte> matrixIndices;
+    QList<GLfloat> batchModelViews;
+
+    DrawState captureDrawState();
+    void applyDrawState(const DrawState & state, DrawState & current);
+    int snapshotMatrix(const QMatrix4x4 & matrix, int previous);
+    void queueDrawPacket();
+    static bool isReorderable(const DrawPacket & packet);
+    static bool sortsBefore(const DrawPacket & a, const DrawPacket & b, bool matrixBatching);
+    static bool canMerge(const DrawPacket & a, GLsizei mergedCount, const DrawPacket & b, bool matrixBatching);
+    void drawDeferred();
+
+public:
+
+    struct Stats {
+        quint64 verticesSubmitted = 0;
+        quint64 verticesUploaded = 0;
+        quint64 indicesUploaded = 0;
+        // bytes of vertex data streamed, smaller than 32 per uploaded vertex when attributes were left out
+        quint64 vertexBytesUploaded = 0;
+
+        quint64 drawCalls = 0;
+        quint64 packetsQueued = 0;
+        // texture, raster state and matrix changes issued while flushing deferred draws
+        quint64 stateChanges = 0;
+
+        // draws that picked their modelview per vertex, and batches split because the uniform block was full
+        quint64 matrixBatches = 0;
+        quint64 matrixBatchSplits = 0;
+
+        // redundant state setter calls not passed to GL
+        quint64 stateCallsSkipped = 0;
+
+        // the time beginFrame blocked, and an upper bound of the time from endFrame until the fence signaled
+        quint64 frames = 0;
+        quint64 cpuWaitNanoseconds = 0;
+        quint64 framesRetired = 0;
+        quint64 gpuLagNanoseconds = 0;
+
+        // staging memory, allocations counts every (re)allocation and trims the ones that gave memory back
+        quint64 stagingAllocations = 0;
+        quint64 stagingTrims = 0;
+        quint64 stagingCapacityBytes = 0;
+
+        // submitted vertices per uploaded vertex, 1 when nothing was deduplicated
+        double vertexCompressionRatio() const;
+    };
+
+private:
+    Stats stats;
 
 public:
 
     void glBegin(GLenum mode);
     void glEnd();
 
+    // context must be current, shares its program and static buffers with the share group
     GLES1_Wrapper(QOpenGLContext * context);
 
+    // draws into rasterizer instead of GL, which must outlive the wrapper,
+    // glDrawPixels and readPixelsAsync do nothing
+    GLES1_Wrapper(GLES1_SoftwareRasterizer * rasterizer);
+
+    // context must be current
+    ~GLES1_Wrapper();
+
+    // see GLES1_SharedResources::warmUp
+    static void warmUpShaders(QOpenGLContext * shareContext);
+
+    // records every call into a binary trace at path until stopCapture, see GLES1_TraceReader
+    bool startCapture(const QString & path);
+    void stopCapture();
+    bool isCapturing();
+
+    // when enabled, glEnd queues the block and flush draws the queue sorted by state,
+    // blended blocks and blocks without depth testing keep their order
+    void setDeferredSubmissionEnabled(bool enabled);
+    bool isDeferredSubmissionEnabled();
+
+    // call it at least once per frame
+    void flush();
+
+    // frame pacing, optional, bracket each frame outside glBegin/glEnd, beginFrame waits until fewer than
+    // getMaxFramesInFlight fenced frames are in flight, each frame streams into buffers reused once its fence signaled
+    void beginFrame();
+    void endFrame();
+    // 1 to 3, 2 by default
+    void setMaxFramesInFlight(int frames);
+    int getMaxFramesInFlight();
+
+    // indexes triangle, strip and quad blocks at glEnd, nothing is cached between frames
+    void setVertexDeduplicationEnabled(bool enabled);
+    bool isVertexDeduplicationEnabled();
+
+    // when enabled, flush also merges deferred blocks with different modelviews, each vertex indexes a uniform
+    // block of GLES1_SharedResources::modelViewArraySize matrices, ignored with vertex deduplication
+    void setMatrixBatchingEnabled(bool enabled);
+    bool isMatrixBatchingEnabled();
+
+    // when enabled, the modelview stack is kept in doubles and vertices are staged relative to the camera
+    // origin, move the origin to the camera once per frame outside glBegin/glEnd
+    void setDoublePrecisionEnabled(bool enabled);
+    bool isDoublePrecisionEnabled();
+    void setCameraOrigin(GLdouble x, GLdouble y, GLdouble z);
+
+    // glDrawPixels draws nothing while the raster position is clipped
+    void glRasterPos2i(GLint x, GLint y);
+    void glRasterPos2f(GLfloat x, GLfloat y);
+    void glRasterPos2d(GLdouble x, GLdouble y);
+    void glRasterPos3f(GLfloat x, GLfloat y, GLfloat z);
+    void glRasterPos3d(GLdouble x, GLdouble y, GLdouble z);
+    void glRasterPos4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+    void glRasterPos4d(GLdouble x, GLdouble y, GLdouble z, GLdouble w);
+
+    // unzoomed, see GLES1_PixelTransfer for the supported formats
+    void glDrawPixels(GLsizei width, GLsizei height, GLenum format, GLenum type, const void * data);
+
+    // glReadPixels without waiting, returns a handle to poll a frame or two later or 0 if the format is not
+    // supported, takeReadPixels returns false while the read is not complete
+    quint32 readPixelsAsync(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type);
+    bool isReadPixelsComplete(quint32 handle);
+    GLsizeiptr readPixelsSize(quint32 handle);
+    bool takeReadPixels(quint32 handle, void * data);
+    void cancelReadPixels(quint32 handle);
+
+    // GL_RENDER and GL_SELECT, leaving GL_SELECT returns the number of hits or -1 on overflow
+    GLint glRenderMode(GLenum mode);
+    void glSelectBuffer(GLsizei size, GLuint * buffer);
+    void glInitNames();
+    void glPushName(GLuint name);
+    void glPopName();
+    void glLoadName(GLuint name);
+
+    // multiplies the current matrix with a projection restricting drawing to the given region of the viewport
+    void gluPickMatrix(GLdouble x, GLdouble y, GLdouble width, GLdouble height, const GLint * viewport);
+
+    // see GLES1_AttribStack
+    void glPushAttrib(GLbitfield mask);
+    void glPopAttrib();
+
+    // call after changing the shadowed state without going through the wrapper
+    void invalidateState();
+    void glClear(GLbitfield mask);
+    void glEnable(GLenum capability);
+    void glDisable(GLenum capability);
+    void glBlendFunc(GLenum source, GLenum destination);
+    void glBlendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha);
+    void glBlendEquation(GLenum mode);
+    void glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha);
+    void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void glDepthFunc(GLenum func);
+    void glDepthMask(GLboolean flag);
+    void glClearDepth(GLdouble depth);
+    void glDepthRange(GLdouble nearVal, GLdouble farVal);
+    void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void glScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+    void glActiveTexture(GLenum unit);
+    void glBindTexture(GLenum target, GLuint texture);
+    void glDeleteTextures(GLsizei count, const GLuint * textures);
+
+    // counters accumulate until resetStats
+    // the memory held by every wrapper of the process is reported by GLES1_MemoryAccounting
+    const Stats & getStats();
+    void resetStats();
+
     void glOrtho(	GLdouble left,
         GLdouble right,
         GLdouble bottom,